@@ -13,73 +13,343 @@
 #include <juce_dsp/juce_dsp.h>
 #include <juce_gui_basics/juce_gui_basics.h>
 
+#include "Tracing.h"
+
+//==============================================================================
+/**
+    Maps the linearly spaced FFT bins onto pixels of a logarithmic frequency axis
+    spanning 10 octaves. Each pixel takes the maximum of the bins it covers, or
+    interpolates between the neighbouring bins where one bin spans several pixels.
+    The table only needs to be rebuilt when the size or the sample rate change.
+*/
+class BinToPixelMap
+{
+public:
+    BinToPixelMap() = default;
+
+    /** Rebuilds the table if any of the arguments changed. Returns true if it was rebuilt. */
+    bool prepare (int numPixelsToUse, int numBinsToUse, float binWidthToUse, float minFreqToUse)
+    {
+        if (numPixelsToUse == numPixels && numBinsToUse == numBins
+            && binWidthToUse == binWidth && minFreqToUse == minFreq)
+            return false;
+
+        numPixels = numPixelsToUse;
+        numBins   = numBinsToUse;
+        binWidth  = binWidthToUse;
+        minFreq   = minFreqToUse;
+
+        pixels.resize (size_t (std::max (numPixels, 0)));
+
+        for (int x = 0; x < numPixels; ++x)
+        {
+            const auto lower = minFreq * std::pow (2.0f, 10.0f * float (x) / float (numPixels)) / binWidth;
+            const auto upper = minFreq * std::pow (2.0f, 10.0f * float (x + 1) / float (numPixels)) / binWidth;
+
+            auto& pixel = pixels [size_t (x)];
+            pixel.first = juce::jlimit (0, numBins - 1, int (std::ceil (lower)));
+            pixel.num   = juce::jlimit (0, numBins - pixel.first, int (std::ceil (upper)) - pixel.first);
+
+            if (pixel.num == 0)
+            {
+                const auto centre = juce::jlimit (0.0f, float (numBins - 2), 0.5f * (lower + upper));
+                pixel.first = int (centre);
+                pixel.frac  = centre - float (pixel.first);
+            }
+        }
+
+        return true;
+    }
+
+    int getNumPixels() const    { return numPixels; }
+
+    /** Writes one level per pixel, the bins need to hold the number of bins given in prepare() */
+    void process (const float* bins, float* dest) const noexcept
+    {
+        for (const auto& pixel : pixels)
+        {
+            if (pixel.num > 0)
+                *dest++ = juce::FloatVectorOperations::findMaximum (bins + pixel.first, pixel.num);
+            else
+                *dest++ = bins [pixel.first] + pixel.frac * (bins [pixel.first + 1] - bins [pixel.first]);
+        }
+    }
+
+    /** Converts gains to decibels in place, in one pass without branches */
+    static void toDecibels (float* data, int num, float minusInfinityDb) noexcept
+    {
+        const auto floor = juce::Decibels::decibelsToGain (minusInfinityDb);
+        for (int i = 0; i < num; ++i)
+            data [i] = 20.0f * std::log10 (std::max (data [i], floor));
+    }
+
+private:
+    struct Pixel
+    {
+        int   first = 0;
+        int   num   = 0;
+        float frac  = 0.0f;
+    };
+
+    std::vector<Pixel> pixels;
+    int   numPixels = 0;
+    int   numBins   = 0;
+    float binWidth  = 0.0f;
+    float minFreq   = 0.0f;
+};
+
+//==============================================================================
+/**
+    One stage of a decimation by two with a half-band FIR low pass. Every other tap of a
+    half-band filter is zero, so only the others are kept, and the output is only computed
+    for the samples that are kept. The taps are designed once and shared by all stages.
+*/
+template<typename Type>
+class HalfBandDecimator
+{
+public:
+    struct Tap
+    {
+        int  offset;
+        Type coefficient;
+    };
+
+    /** Designs the taps, this allocates. The pass band reaches 0.21 of the input rate, i.e.
+        20 kHz at 96 kHz, and the stop band from 0.29 on is 80 dB down. */
+    static std::vector<Tap> designTaps()
+    {
+        auto fir = juce::dsp::FilterDesign<Type>::designFIRLowpassHalfBandEquirippleMethod (Type (0.08), Type (-80));
+
+        std::vector<Tap> taps;
+        for (int i = 0; i <= int (fir->getFilterOrder()); ++i)
+            if (fir->getRawCoefficients() [i] != Type (0))
+                taps.push_back ({ i, fir->getRawCoefficients() [i] });
+
+        return taps;
+    }
+
+    /** Clears the history, the length needs to cover the highest offset of the taps */
+    void prepare (int lengthToUse)
+    {
+        length = lengthToUse;
+        history.assign (size_t (2 * length), Type (0));
+        position = 0;
+    }
+
+    void push (Type sample) noexcept
+    {
+        // written twice, so the last length samples are always contiguous
+        history [size_t (position)] = sample;
+        history [size_t (position + length)] = sample;
+        if (++position == length)
+            position = 0;
+    }
+
+    Type compute (const std::vector<Tap>& taps) const noexcept
+    {
+        const auto* samples = history.data() + position;
+        auto sum = Type (0);
+        for (const auto& tap : taps)
+            sum += tap.coefficient * samples [tap.offset];
+
+        return sum;
+    }
+
+private:
+    std::vector<Type> history;
+    int length   = 0;
+    int position = 0;
+};
+
 //==============================================================================
 /*
+    Analyses a number of signals, e.g. input and output, each with a number of channels.
+    The channels are transformed pairwise, packed as real and imaginary part into one
+    complex FFT. From the separated channel spectra the views are derived: the sum of
+    all channels, mid and side of the first two channels and each individual channel.
 */
 template<typename Type>
 class Analyser : public juce::Thread
 {
 public:
-    Analyser() : juce::Thread ("Frequaliser-Analyser")
+    enum class AveragingMode
     {
-        averager.clear();
+        Exponential = 0,    // running average with a user time constant
+        Infinite,           // long term mean of all frames since the last reset
+        PeakHold            // maximum per bin, decaying with a fixed rate
+    };
+
+    enum View
+    {
+        SumView = 0,
+        MidView,
+        SideView,
+        FirstChannelView    // followed by one view for each channel
+    };
+
+    /** Number of unaveraged frames of the sum view kept for getFramePixelLevels() */
+    static constexpr int frameHistoryLength = 16;
+
+    Analyser (int numSignalsToUse = 2)
+      : juce::Thread ("Frequaliser-Analyser"),
+        numSignals (std::max (numSignalsToUse, 1))
+    {
+        juce::dsp::WindowingFunction<float>::fillWindowingTables (window.data(), window.size(),
+                                                                 juce::dsp::WindowingFunction<float>::hann, true);
+        resizeBuffers();
     }
 
     ~Analyser() override = default;
 
-    void addAudioData (const juce::AudioBuffer<Type>& buffer, int startChannel, int numChannels)
+    struct Diagnostics
+    {
+        juce::int64 receivedSamples = 0;    // samples offered to the FIFO, after decimation
+        juce::int64 droppedSamples  = 0;    // samples that didn't fit into the FIFO
+        juce::int64 analysedFrames  = 0;
+        int         decimation      = 1;
+        float       peakLevel       = 0.0f; // highest sample of all signals in the last frame
+    };
+
+    /** Adds the channels of one signal to the analyser. The signals of one block need to be
+        added in ascending order, the block is handed to the analyser thread once the last
+        signal was added. If the FIFO is full, only the most recent samples that fit are written
+        and the rest is counted as dropped. This is the only method called on the audio thread. */
+    void addAudioData (const juce::AudioBuffer<Type>& buffer, int startChannel, int numChannelsToAdd, int signal)
     {
-        if (abstractFifo.getFreeSpace() < buffer.getNumSamples())
+        if (signal == 0)
+        {
+            const auto numDecimated = (decimationPhase + buffer.getNumSamples()) / decimation;
+            const auto numToWrite   = std::min (numDecimated, abstractFifo.getFreeSpace());
+
+            numReceivedSamples.fetch_add (numDecimated, std::memory_order_relaxed);
+            if (numToWrite < numDecimated)
+                numDroppedSamples.fetch_add (numDecimated - numToWrite, std::memory_order_relaxed);
+
+            abstractFifo.prepareToWrite (numToWrite, writeStart1, writeBlock1, writeStart2, writeBlock2);
+            writeSkip  = numDecimated - numToWrite;
+            nextSignal = 0;
+        }
+
+        if (signal != nextSignal)
             return;
 
-        int start1, block1, start2, block2;
-        abstractFifo.prepareToWrite (buffer.getNumSamples(), start1, block1, start2, block2);
-        audioFifo.copyFrom (0, start1, buffer.getReadPointer (startChannel), block1);
-        if (block2 > 0)
-            audioFifo.copyFrom (0, start2, buffer.getReadPointer (startChannel, block1), block2);
+        // with a full FIFO writeSkip is the buffer length and getReadPointer() would assert, so
+        // nothing is written directly. The decimators still run to keep their filter state.
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            const auto stream = signal * numChannels + channel;
+
+            if (channel >= numChannelsToAdd)
+                clearStream (stream);
+            else if (decimation > 1)
+                writeDecimated (buffer.getReadPointer (startChannel + channel), buffer.getNumSamples(), stream);
+            else if (writeBlock1 + writeBlock2 > 0)
+                writeDirect (buffer.getReadPointer (startChannel + channel, writeSkip), stream);
+        }
 
-        for (int channel = startChannel + 1; channel < startChannel + numChannels; ++channel)
+        if (++nextSignal == numSignals)
         {
-            if (block1 > 0) audioFifo.addFrom (0, start1, buffer.getReadPointer (channel), block1);
-            if (block2 > 0) audioFifo.addFrom (0, start2, buffer.getReadPointer (channel, block1), block2);
+            abstractFifo.finishedWrite (writeBlock1 + writeBlock2);
+            decimationPhase = (decimationPhase + buffer.getNumSamples()) % decimation;
+            nextSignal = -1;
+            waitForData.signal();
         }
-        abstractFifo.finishedWrite (block1 + block2);
-        waitForData.signal();
     }
 
-    void setupAnalyser (int audioFifoSize, Type sampleRateToUse)
+    /** Prepares the FIFO and (re-)starts the analyser thread. A decimation above 1 needs to be
+        a power of two, the audio thread then low passes and decimates by two that many times
+        with half-band filters, reducing the FIFO traffic and the highest analysed frequency
+        by that factor without aliasing. */
+    void setupAnalyser (int audioFifoSize, Type sampleRateToUse, int numChannelsToUse = 1, int decimationToUse = 1)
     {
-        sampleRate = sampleRateToUse;
-        audioFifo.setSize (1, audioFifoSize);
-        abstractFifo.setTotalSize (audioFifoSize);
+        stopThread (1000);
+
+        jassert (juce::isPowerOfTwo (std::max (decimationToUse, 1)));
+        decimation = std::max (decimationToUse, 1);
+        sampleRate = sampleRateToUse / Type (decimation);
 
+        {
+            juce::ScopedLock lockedForResizing (pathCreationLock);
+            numChannels = juce::jlimit (1, maxChannels, numChannelsToUse);
+            resizeBuffers();
+        }
+
+        audioFifo.setSize (numSignals * numChannels, audioFifoSize / decimation);
+        abstractFifo.setTotalSize (audioFifoSize / decimation);
+        if (decimationTaps.empty())
+            decimationTaps = HalfBandDecimator<Type>::designTaps();
+
+        numDecimationStages = 0;
+        while ((1 << numDecimationStages) < decimation)
+            ++numDecimationStages;
+
+        decimators.resize (size_t (numSignals * numChannels * numDecimationStages));
+        for (auto& decimator : decimators)
+            decimator.prepare (decimationTaps.back().offset + 1);
+
+        decimationPhase = 0;
+        nextSignal = -1;
+
+        resetAveraging();
         startThread (5);
     }
 
+    Diagnostics getDiagnostics() const
+    {
+        Diagnostics diagnostics;
+        diagnostics.receivedSamples = numReceivedSamples.load();
+        diagnostics.droppedSamples  = numDroppedSamples.load();
+        diagnostics.analysedFrames  = numAnalysedFrames.load();
+        diagnostics.decimation      = decimation;
+        diagnostics.peakLevel       = lastPeakLevel.load();
+        return diagnostics;
+    }
+
     void run() override
     {
+        FREQUALIZER_TRACE_THREAD ("Analyser")
         while (! threadShouldExit())
         {
             if (abstractFifo.getNumReady() >= fft.getSize())
             {
-                fftBuffer.clear();
-
+                FREQUALIZER_TRACE_SCOPE ("FFT frame")
                 int start1, block1, start2, block2;
                 abstractFifo.prepareToRead (fft.getSize(), start1, block1, start2, block2);
-                if (block1 > 0) fftBuffer.copyFrom (0, 0, audioFifo.getReadPointer (0, start1), block1);
-                if (block2 > 0) fftBuffer.copyFrom (0, block1, audioFifo.getReadPointer (0, start2), block2);
+
+                auto peak = 0.0f;
+                for (int stream = 0; stream < audioFifo.getNumChannels(); ++stream)
+                    peak = std::max ({ peak, float (audioFifo.getMagnitude (stream, start1, block1)),
+                                             float (audioFifo.getMagnitude (stream, start2, block2)) });
+                lastPeakLevel.store (peak);
+
+                for (int stream = 0; stream < audioFifo.getNumChannels(); stream += 2)
+                {
+                    packStreams (stream, 0, start1, block1);
+                    packStreams (stream, block1, start2, block2);
+
+                    fft.perform (timeData.data(), spectrum.data(), false);
+
+                    unpackSpectra (spectrum.data(),
+                                   spectraReal.getWritePointer (stream), spectraImag.getWritePointer (stream),
+                                   spectraReal.getWritePointer (stream + 1), spectraImag.getWritePointer (stream + 1),
+                                   fft.getSize());
+                }
+
                 abstractFifo.finishedRead ((block1 + block2) / 2);
 
-                windowing.multiplyWithWindowingTable (fftBuffer.getWritePointer (0), size_t (fft.getSize()));
-                fft.performFrequencyOnlyForwardTransform (fftBuffer.getWritePointer (0));
+                // the sum view is always computed for the frame history
+                const auto visible = getComputedViews();
+                calculateViews (visible | (1u << SumView));
 
+                FREQUALIZER_TRACE_BEGIN ("wait pathCreationLock")
                 juce::ScopedLock lockedForWriting (pathCreationLock);
-                averager.addFrom (0, 0, averager.getReadPointer (averagerPtr), averager.getNumSamples(), -1.0f);
-                averager.copyFrom (averagerPtr, 0, fftBuffer.getReadPointer (0), averager.getNumSamples(), 1.0f / (averager.getNumSamples() * (averager.getNumChannels() - 1)));
-                averager.addFrom (0, 0, averager.getReadPointer (averagerPtr), averager.getNumSamples());
-                if (++averagerPtr == averager.getNumChannels()) averagerPtr = 1;
+                FREQUALIZER_TRACE_END ("wait pathCreationLock")
+                storeFrame();
+                const auto changed = updateAverager (visible);
 
-                newDataAvailable = true;
+                numAnalysedFrames.fetch_add (1, std::memory_order_relaxed);
+                if (changed)
+                    newDataAvailable = true;
             }
 
             if (abstractFifo.getNumReady() < fft.getSize())
@@ -87,20 +357,157 @@ public:
         }
     }
 
-    void createPath (juce::Path& p, const juce::Rectangle<float> bounds, float minFreq)
+    void createPath (juce::Path& p, const juce::Rectangle<float> bounds, float minFreq, int signal, int view = SumView)
     {
+        FREQUALIZER_TRACE_SCOPE ("createPath")
         p.clear();
-        p.preallocateSpace (8 + averager.getNumSamples() * 3);
 
+        const auto numPixels = juce::roundToInt (bounds.getWidth());
+        if (numPixels < 2 || ! getPixelLevels (pathPixelMap, pathLevels, numPixels, minFreq, signal, view))
+            return;
+
+        BinToPixelMap::toDecibels (pathLevels.data(), numPixels, infinity);
+
+        p.preallocateSpace (8 + numPixels * 3);
+        p.startNewSubPath (bounds.getX(), levelToY (pathLevels [0], bounds));
+        for (int i = 1; i < numPixels; ++i)
+            p.lineTo (bounds.getX() + float (i), levelToY (pathLevels [size_t (i)], bounds));
+    }
+
+    /** Fills levels with the averaged gain of a view of a signal per pixel of a logarithmic axis
+        starting at minFreq. The map is rebuilt only if the size or sample rate changed. */
+    bool getPixelLevels (BinToPixelMap& map, std::vector<float>& levels, int numPixels, float minFreq, int signal, int view = SumView)
+    {
+        if (sampleRate <= 0)
+            return false;
+
+        map.prepare (numPixels, averager.getNumSamples(), float (sampleRate) / float (fft.getSize()), minFreq);
+        levels.resize (size_t (numPixels));
+
+        FREQUALIZER_TRACE_BEGIN ("wait pathCreationLock")
+        juce::ScopedLock lockedForReading (pathCreationLock);
+        FREQUALIZER_TRACE_END ("wait pathCreationLock")
+        if (! juce::isPositiveAndBelow (view, getNumViews()))
+            return false;
+
+        map.process (averager.getReadPointer (juce::jlimit (0, numSignals - 1, signal) * getNumViews() + view), levels.data());
+        return true;
+    }
+
+    /** Fills levels with the unaveraged gain of the sum view of a signal in one analysed frame,
+        counting from 0 like Diagnostics::analysedFrames. Returns false if the frame isn't
+        analysed yet or was already overwritten, only the last frameHistoryLength are kept. */
+    bool getFramePixelLevels (BinToPixelMap& map, std::vector<float>& levels, int numPixels, float minFreq, int signal, juce::int64 frame)
+    {
+        if (sampleRate <= 0)
+            return false;
+
+        map.prepare (numPixels, frameHistory.getNumSamples(), float (sampleRate) / float (fft.getSize()), minFreq);
+        levels.resize (size_t (numPixels));
+
+        FREQUALIZER_TRACE_BEGIN ("wait pathCreationLock")
+        juce::ScopedLock lockedForReading (pathCreationLock);
+        FREQUALIZER_TRACE_END ("wait pathCreationLock")
+
+        // the counter is advanced under this lock, together with storing the frame
+        const auto numFrames = numAnalysedFrames.load();
+        if (frame >= numFrames || frame < numFrames - frameHistoryLength || frame < 0)
+            return false;
+
+        const auto row = juce::jlimit (0, numSignals - 1, signal) * frameHistoryLength + int (frame % frameHistoryLength);
+        map.process (frameHistory.getReadPointer (row), levels.data());
+        return true;
+    }
+
+    /** Copies the averaged gains of a view of a signal into bins and returns the width of
+        one bin in Hz, or 0 if the analyser isn't set up yet. */
+    float copyAverage (std::vector<float>& bins, int signal, int view = SumView)
+    {
+        if (sampleRate <= 0)
+            return 0.0f;
+
+        bins.resize (size_t (averager.getNumSamples()));
+
+        FREQUALIZER_TRACE_BEGIN ("wait pathCreationLock")
         juce::ScopedLock lockedForReading (pathCreationLock);
-        const auto* fftData = averager.getReadPointer (0);
-        const auto  factor  = bounds.getWidth() / 10.0f;
+        FREQUALIZER_TRACE_END ("wait pathCreationLock")
+        if (! juce::isPositiveAndBelow (view, getNumViews()))
+            return 0.0f;
 
-        p.startNewSubPath (bounds.getX() + factor * indexToX (0, minFreq), binToY (fftData [0], bounds));
-        for (int i = 0; i < averager.getNumSamples(); ++i)
-            p.lineTo (bounds.getX() + factor * indexToX (float (i), minFreq), binToY (fftData [i], bounds));
+        juce::FloatVectorOperations::copy (bins.data(),
+                                           averager.getReadPointer (juce::jlimit (0, numSignals - 1, signal) * getNumViews() + view),
+                                           averager.getNumSamples());
+        return float (sampleRate) / float (fft.getSize());
     }
 
+    int getNumChannels() const
+    {
+        return numChannels;
+    }
+
+    int getNumViews() const
+    {
+        return FirstChannelView + numChannels;
+    }
+
+    /** Selects the views to compute as bit mask, bit n selecting view n. Only the selected views
+        are averaged, the others are skipped on the analyser thread. */
+    void setVisibleViews (juce::uint32 mask)
+    {
+        visibleViews.store (mask);
+        resetAveraging();
+    }
+
+    juce::uint32 getVisibleViews() const
+    {
+        return visibleViews.load();
+    }
+
+    bool isViewVisible (int view) const
+    {
+        return juce::isPositiveAndBelow (view, getNumViews()) && (getComputedViews() & (1u << view)) != 0;
+    }
+
+    void setAveragingMode (AveragingMode newMode)
+    {
+        averagingMode.store (newMode);
+        resetAveraging();
+    }
+    AveragingMode getAveragingMode() const
+    {
+        return averagingMode.load();
+    }
+
+    /** Sets the time constant in seconds used by AveragingMode::Exponential */
+    void setAveragingTime (float seconds)
+    {
+        averagingTime.store (std::max (seconds, 0.001f));
+    }
+
+    float getAveragingTime() const
+    {
+        return averagingTime.load();
+    }
+
+    /** Sets the fall back rate of AveragingMode::PeakHold in dB per second */
+    void setPeakDecay (float decibelsPerSecond)
+    {
+        peakDecay.store (std::max (decibelsPerSecond, 0.0f));
+    }
+
+    float getPeakDecay() const
+    {
+        return peakDecay.load();
+    }
+
+    /** Restarts the averaging with the next frame, the old average is discarded */
+    void resetAveraging()
+    {
+        resetRequested.store (true);
+    }
+
+    /** Returns true once after a frame changed the displayed average, i.e. a view of the average
+        was above the display floor of -80 dB before or after the frame. Silence doesn't count. */
     bool checkForNewData()
     {
         auto available = newDataAvailable.load();
@@ -110,35 +517,312 @@ public:
 
 private:
 
-    inline float indexToX (float index, float minFreq) const
+    void resizeBuffers()
     {
-        const auto freq = (sampleRate * index) / fft.getSize();
-        return (freq > 0.01f) ? std::log (freq / minFreq) / std::log (2.0f) : 0.0f;
+        const auto numStreams = numSignals * numChannels;
+        const auto numBins    = fft.getSize() / 2;
+
+        spectraReal.setSize (numStreams + (numStreams % 2), numBins);
+        spectraImag.setSize (numStreams + (numStreams % 2), numBins);
+        sumReal.setSize (1, numBins);
+        sumImag.setSize (1, numBins);
+        magnitudes.setSize (numSignals * getNumViews(), numBins);
+        averager.setSize (numSignals * getNumViews(), numBins);
+        averager.clear();
+        frameHistory.setSize (numSignals * frameHistoryLength, numBins);
+        frameHistory.clear();
     }
 
-    inline float binToY (float bin, const juce::Rectangle<float> bounds) const
+    juce::uint32 getComputedViews() const
     {
-        const float infinity = -80.0f;
-        return juce::jmap (juce::Decibels::gainToDecibels (bin, infinity),
-                           infinity, 0.0f, bounds.getBottom(), bounds.getY());
+        auto mask = visibleViews.load() & ((1u << getNumViews()) - 1u);
+        if (numChannels < 2)
+            mask &= ~((1u << MidView) | (1u << SideView));
+
+        return mask;
+    }
+
+    void writeDirect (const Type* source, int stream)
+    {
+        if (writeBlock1 > 0) audioFifo.copyFrom (stream, writeStart1, source, writeBlock1);
+        if (writeBlock2 > 0) audioFifo.copyFrom (stream, writeStart2, source + writeBlock1, writeBlock2);
+    }
+
+    void writeDecimated (const Type* source, int numSamples, int stream)
+    {
+        auto* fifo   = audioFifo.getWritePointer (stream);
+        auto* stages = decimators.data() + stream * numDecimationStages;
+        auto  phase  = decimationPhase;
+        auto  index  = -writeSkip;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            auto sample = source [i];
+            ++phase;
+
+            // stage s receives every 2^s-th sample and computes an output for every other of those
+            for (int s = 0; s < numDecimationStages; ++s)
+            {
+                stages [s].push (sample);
+                if ((phase & ((2 << s) - 1)) != 0)
+                    break;
+
+                sample = stages [s].compute (decimationTaps);
+
+                if (s == numDecimationStages - 1)
+                {
+                    if (index >= 0)
+                        fifo [index < writeBlock1 ? writeStart1 + index : writeStart2 + index - writeBlock1] = sample;
+
+                    ++index;
+                }
+            }
+
+            if (phase == decimation)
+                phase = 0;
+        }
+    }
+
+    void clearStream (int stream)
+    {
+        if (writeBlock1 > 0) audioFifo.clear (stream, writeStart1, writeBlock1);
+        if (writeBlock2 > 0) audioFifo.clear (stream, writeStart2, writeBlock2);
+    }
+
+    void calculateViews (juce::uint32 visible)
+    {
+        const auto numBins  = magnitudes.getNumSamples();
+        const auto numViews = getNumViews();
+
+        for (int signal = 0; signal < numSignals; ++signal)
+        {
+            const auto first = signal * numChannels;
+            auto getDest = [&] (int view) { return magnitudes.getWritePointer (signal * numViews + view); };
+
+            if (visible & (1u << SumView))
+            {
+                if (numChannels == 1)
+                {
+                    magnitude (spectraReal.getReadPointer (first), spectraImag.getReadPointer (first), getDest (SumView), numBins);
+                }
+                else
+                {
+                    juce::FloatVectorOperations::add (sumReal.getWritePointer (0), spectraReal.getReadPointer (first), spectraReal.getReadPointer (first + 1), numBins);
+                    juce::FloatVectorOperations::add (sumImag.getWritePointer (0), spectraImag.getReadPointer (first), spectraImag.getReadPointer (first + 1), numBins);
+                    for (int channel = 2; channel < numChannels; ++channel)
+                    {
+                        juce::FloatVectorOperations::add (sumReal.getWritePointer (0), spectraReal.getReadPointer (first + channel), numBins);
+                        juce::FloatVectorOperations::add (sumImag.getWritePointer (0), spectraImag.getReadPointer (first + channel), numBins);
+                    }
+                    magnitude (sumReal.getReadPointer (0), sumImag.getReadPointer (0), getDest (SumView), numBins);
+                }
+            }
+
+            if (visible & (1u << MidView))
+                magnitudeOfSum (spectraReal.getReadPointer (first), spectraImag.getReadPointer (first),
+                                spectraReal.getReadPointer (first + 1), spectraImag.getReadPointer (first + 1),
+                                1.0f, getDest (MidView), numBins);
+
+            if (visible & (1u << SideView))
+                magnitudeOfSum (spectraReal.getReadPointer (first), spectraImag.getReadPointer (first),
+                                spectraReal.getReadPointer (first + 1), spectraImag.getReadPointer (first + 1),
+                                -1.0f, getDest (SideView), numBins);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+                if (visible & (1u << (FirstChannelView + channel)))
+                    magnitude (spectraReal.getReadPointer (first + channel), spectraImag.getReadPointer (first + channel),
+                               getDest (FirstChannelView + channel), numBins);
+        }
     }
 
+    /** Keeps the sum view of each signal of the current frame, in the same scale as the averager */
+    void storeFrame()
+    {
+        const auto numBins = frameHistory.getNumSamples();
+        const auto slot    = int (numAnalysedFrames.load() % frameHistoryLength);
+
+        for (int signal = 0; signal < numSignals; ++signal)
+            juce::FloatVectorOperations::copyWithMultiply (frameHistory.getWritePointer (signal * frameHistoryLength + slot),
+                                                           magnitudes.getReadPointer (signal * getNumViews() + SumView),
+                                                           1.0f / numBins, numBins);
+    }
+
+    /** Returns true if the frame changed anything above the display floor */
+    bool updateAverager (juce::uint32 visible)
+    {
+        const auto numBins  = averager.getNumSamples();
+        const auto numViews = getNumViews();
+        const auto scale    = 1.0f / numBins;
+        const auto duration = float (fft.getSize() / 2) / float (sampleRate);
+
+        if (resetRequested.exchange (false))
+            numAveragedFrames = 0;
+
+        const auto mode  = numAveragedFrames++ == 0 ? AveragingMode::Infinite : averagingMode.load();
+        const auto alpha = mode == AveragingMode::Exponential ? 1.0f - std::exp (-duration / averagingTime.load())
+                                                              : 1.0f / float (numAveragedFrames);
+        const auto decay = juce::Decibels::decibelsToGain (-peakDecay.load() * duration);
+        const auto floor = juce::Decibels::decibelsToGain (infinity);
+        auto isAboveFloor = false;
+
+        for (int row = 0; row < averager.getNumChannels(); ++row)
+        {
+            if ((visible & (1u << (row % numViews))) == 0)
+                continue;
+
+            auto*       average = averager.getWritePointer (row);
+            const auto* input   = magnitudes.getReadPointer (row);
+
+            if (numAveragedFrames == 1)
+                juce::FloatVectorOperations::copyWithMultiply (average, input, scale, numBins);
+            else if (mode == AveragingMode::PeakHold)
+                hold (average, input, scale, decay, numBins);
+            else
+                blend (average, input, scale, alpha, numBins);
+
+            isAboveFloor = isAboveFloor || juce::FloatVectorOperations::findMaximum (average, numBins) > floor;
+        }
+
+        return std::exchange (wasAboveFloor, isAboveFloor) || isAboveFloor;
+    }
+
+    /** Interleaves two windowed FIFO channels as real and imaginary part for the complex FFT */
+    void packStreams (int stream, int offset, int fifoStart, int num)
+    {
+        if (num <= 0)
+            return;
+
+        auto*       packed = reinterpret_cast<float*> (timeData.data() + offset);
+        const auto* w      = window.data() + offset;
+        const auto* re     = audioFifo.getReadPointer (stream, fifoStart);
+
+        if (stream + 1 < audioFifo.getNumChannels())
+        {
+            const auto* im = audioFifo.getReadPointer (stream + 1, fifoStart);
+            for (int i = 0; i < num; ++i)
+            {
+                packed [2 * i]     = float (re [i]) * w [i];
+                packed [2 * i + 1] = float (im [i]) * w [i];
+            }
+        }
+        else
+        {
+            for (int i = 0; i < num; ++i)
+            {
+                packed [2 * i]     = float (re [i]) * w [i];
+                packed [2 * i + 1] = 0.0f;
+            }
+        }
+    }
+
+    /** Separates the spectra of the two real signals packed into one complex FFT:
+        A[k] = (Z[k] + Z*[N-k]) / 2 and B[k] = (Z[k] - Z*[N-k]) / 2j */
+    static void unpackSpectra (const juce::dsp::Complex<float>* z, float* realA, float* imagA, float* realB, float* imagB, int size) noexcept
+    {
+        realA [0] = z [0].real();
+        imagA [0] = 0.0f;
+        realB [0] = z [0].imag();
+        imagB [0] = 0.0f;
+
+        for (int k = 1; k < size / 2; ++k)
+        {
+            const auto a = z [k].real(), b = z [k].imag();
+            const auto c = z [size - k].real(), d = z [size - k].imag();
+
+            realA [k] = 0.5f * (a + c);
+            imagA [k] = 0.5f * (b - d);
+            realB [k] = 0.5f * (b + d);
+            imagB [k] = 0.5f * (c - a);
+        }
+    }
+
+    static void magnitude (const float* real, const float* imag, float* dest, int num) noexcept
+    {
+        for (int i = 0; i < num; ++i)
+            dest [i] = std::sqrt (real [i] * real [i] + imag [i] * imag [i]);
+    }
+
+    /** Magnitude of (A + sign * B) / 2, which gives mid and side from left and right */
+    static void magnitudeOfSum (const float* realA, const float* imagA, const float* realB, const float* imagB,
+                                float sign, float* dest, int num) noexcept
+    {
+        for (int i = 0; i < num; ++i)
+        {
+            const auto real = realA [i] + sign * realB [i];
+            const auto imag = imagA [i] + sign * imagB [i];
+            dest [i] = 0.5f * std::sqrt (real * real + imag * imag);
+        }
+    }
+
+    // single pass kernels, written so the compiler can vectorise them
+    static void blend (float* average, const float* input, float scale, float alpha, int num) noexcept
+    {
+        for (int i = 0; i < num; ++i)
+            average [i] += alpha * (scale * input [i] - average [i]);
+    }
+
+    static void hold (float* average, const float* input, float scale, float decay, int num) noexcept
+    {
+        for (int i = 0; i < num; ++i)
+            average [i] = std::max (scale * input [i], decay * average [i]);
+    }
+
+    static float levelToY (float decibels, const juce::Rectangle<float> bounds)
+    {
+        return juce::jmap (decibels, infinity, 0.0f, bounds.getBottom(), bounds.getY());
+    }
+
+    static constexpr float infinity = -80.0f;
+
     juce::WaitableEvent waitForData;
     juce::CriticalSection pathCreationLock;
 
     Type sampleRate {};
 
+    static constexpr int maxChannels = 16;
+
+    const int numSignals;
+    int numChannels = 1;
+
     juce::dsp::FFT fft                           { 12 };
-    juce::dsp::WindowingFunction<Type> windowing { size_t (fft.getSize()), juce::dsp::WindowingFunction<Type>::hann, true };
-    juce::AudioBuffer<float> fftBuffer           { 1, fft.getSize() * 2 };
+    std::vector<float> window                    = std::vector<float> (size_t (fft.getSize()));
+    std::vector<juce::dsp::Complex<float>> timeData = std::vector<juce::dsp::Complex<float>> (size_t (fft.getSize()));
+    std::vector<juce::dsp::Complex<float>> spectrum = std::vector<juce::dsp::Complex<float>> (size_t (fft.getSize()));
+    juce::AudioBuffer<float> spectraReal, spectraImag;
+    juce::AudioBuffer<float> sumReal, sumImag;
+    juce::AudioBuffer<float> magnitudes;
 
-    juce::AudioBuffer<float> averager            { 5, fft.getSize() / 2 };
-    int averagerPtr = 1;
+    juce::AudioBuffer<float> averager;
+    juce::AudioBuffer<float> frameHistory;
+    std::atomic<juce::uint32> visibleViews       { 1u << SumView };
+    std::atomic<AveragingMode> averagingMode     { AveragingMode::Exponential };
+    std::atomic<float> averagingTime             { 0.1f };
+    std::atomic<float> peakDecay                 { 20.0f };
+    std::atomic<bool>  resetRequested            { true };
+    int numAveragedFrames = 0;
+    bool wasAboveFloor    = true;
 
     juce::AbstractFifo abstractFifo              { 48000 };
     juce::AudioBuffer<Type> audioFifo;
+    int writeStart1 = 0, writeBlock1 = 0, writeStart2 = 0, writeBlock2 = 0;
+    int writeSkip  = 0;
+    int nextSignal = -1;
+
+    int decimation          = 1;
+    int decimationPhase     = 0;
+    int numDecimationStages = 0;
+    std::vector<typename HalfBandDecimator<Type>::Tap> decimationTaps;
+    std::vector<HalfBandDecimator<Type>>               decimators;    // numDecimationStages per stream
+
+    std::atomic<juce::int64> numReceivedSamples { 0 };
+    std::atomic<juce::int64> numDroppedSamples  { 0 };
+    std::atomic<juce::int64> numAnalysedFrames  { 0 };
+    std::atomic<float>       lastPeakLevel      { 0.0f };
+
+    std::atomic<bool> newDataAvailable { false };
 
-    std::atomic<bool> newDataAvailable;
+    BinToPixelMap      pathPixelMap;
+    std::vector<float> pathLevels;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Analyser)
 };
@@ -0,0 +1,351 @@
+/*
+  ==============================================================================
+
+    This records automation and input audio of a Frequalizer instance
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+
+//==============================================================================
+/**
+    Captures the parameter changes and the input audio of every block into a
+    compact binary file, so a session can be replayed outside the host with
+    frequalizer_replay. The audio thread compares the normalised values of all
+    parameters with the previous block and pushes a record into a preallocated
+    FIFO, a writer thread drains it into the file. If the FIFO runs full the
+    block is dropped and counted, the gap shows in the sample positions.
+
+    Only the last value before a block is seen, like the processor sees it.
+    The band solo is no parameter and is not captured.
+
+    The file is a header followed by one record per block, all values are
+    little endian:
+
+    header:  "FQAC", int32 version, double sample rate, int32 channels,
+             int32 max block size, int32 parameters, parameter IDs (zero terminated)
+    block:   int64 sample position, int32 samples, int32 channels, int32 changes,
+             changes (int32 parameter, float normalised value), float samples per channel
+*/
+class AutomationCapture : private juce::Thread
+{
+public:
+    static constexpr int magic   = 0x43415146;     // "FQAC"
+    static constexpr int version = 1;
+
+    // the Reader rejects headers beyond these, before it sizes anything from them
+    static constexpr int maxChannels       = 64;
+    static constexpr int maxBlockSizeLimit = 65536;
+    static constexpr int maxParameters     = 4096;
+
+    AutomationCapture() : juce::Thread ("Frequalizer-Capture") {}
+
+    ~AutomationCapture() override
+    {
+        stop();
+    }
+
+    /** Starts a capture with the current layout of the processor, call from the message thread */
+    bool start (const juce::File& file, juce::AudioProcessor& processor)
+    {
+        stop();
+
+        auto output = file.createOutputStream();
+        if (output == nullptr)
+            return false;
+
+        output->setPosition (0);
+        output->truncate();
+
+        parameters.clear();
+        for (auto* parameter : processor.getParameters())
+            parameters.push_back (parameter);
+
+        numChannels  = std::max (1, processor.getTotalNumInputChannels());
+        maxBlockSize = std::max (1, processor.getBlockSize());
+
+        output->writeInt (magic);
+        output->writeInt (version);
+        output->writeDouble (processor.getSampleRate());
+        output->writeInt (numChannels);
+        output->writeInt (maxBlockSize);
+        output->writeInt (int (parameters.size()));
+        for (auto* parameter : parameters)
+            output->writeString (getParameterID (*parameter));
+
+        // hosts may exceed the announced block size now and then
+        const auto maxRecordSize = sizeof (juce::int64) + 3 * sizeof (juce::int32)
+                                 + parameters.size() * (sizeof (juce::int32) + sizeof (float))
+                                 + size_t (2 * maxBlockSize * numChannels) * sizeof (float);
+        record.resize (maxRecordSize);
+        fifoData.resize (std::max (size_t (1 << 22), 16 * maxRecordSize));
+        fifo.setTotalSize (int (fifoData.size()));
+        fifo.reset();
+
+        lastValues.assign (parameters.size(), std::numeric_limits<float>::quiet_NaN());
+        currentValues.assign (parameters.size(), 0.0f);
+        samplePosition = 0;
+        numDroppedBlocks.store (0);
+
+        stream = std::move (output);
+        startThread();
+
+        const juce::SpinLock::ScopedLockType lock (recordLock);
+        active.store (true);
+        return true;
+    }
+
+    /** Stops the capture and writes the remaining blocks, call from the message thread */
+    void stop()
+    {
+        {
+            const juce::SpinLock::ScopedLockType lock (recordLock);
+            active.store (false);
+        }
+
+        stopThread (2000);
+
+        if (stream != nullptr)
+        {
+            stream->flush();
+            stream.reset();
+        }
+    }
+
+    bool isCapturing() const
+    {
+        return active.load (std::memory_order_relaxed);
+    }
+
+    int getNumDroppedBlocks() const
+    {
+        return numDroppedBlocks.load();
+    }
+
+    /** Called by processBlock with the input, before the block is processed */
+    void recordBlock (const juce::AudioBuffer<float>& buffer)
+    {
+        if (! isCapturing())
+            return;
+
+        const juce::SpinLock::ScopedTryLockType lock (recordLock);
+        if (! lock.isLocked() || ! isCapturing())
+            return;
+
+        // empty blocks aren't recorded, their changes go with the next block
+        const auto numSamples  = buffer.getNumSamples();
+        if (numSamples <= 0)
+            return;
+
+        const auto numRecorded = std::min (numChannels, buffer.getNumChannels());
+        auto* writePos = record.data();
+
+        auto append = [&writePos] (const void* data, size_t numBytes)
+        {
+            std::memcpy (writePos, data, numBytes);
+            writePos += numBytes;
+        };
+
+        append (&samplePosition, sizeof (samplePosition));
+        samplePosition += numSamples;
+
+        if (numSamples > getBlockSizeLimit (maxBlockSize))
+        {
+            dropBlock();
+            return;
+        }
+
+        const juce::int32 header[] = { numSamples, numRecorded, 0 };
+        append (header, sizeof (header));
+
+        juce::int32 numChanges = 0;
+        for (size_t i = 0; i < parameters.size(); ++i)
+        {
+            const auto value = parameters [i]->getValue();
+            currentValues [i] = value;
+            if (value != lastValues [i])     // NaN never compares equal, so the first block has all values
+            {
+                const auto index = juce::int32 (i);
+                append (&index, sizeof (index));
+                append (&value, sizeof (value));
+                ++numChanges;
+            }
+        }
+        std::memcpy (record.data() + sizeof (juce::int64) + 2 * sizeof (juce::int32), &numChanges, sizeof (numChanges));
+
+        for (int channel = 0; channel < numRecorded; ++channel)
+            append (buffer.getReadPointer (channel), size_t (numSamples) * sizeof (float));
+
+        const auto size = int (writePos - record.data());
+        if (fifo.getFreeSpace() < size)
+        {
+            dropBlock();
+            return;
+        }
+
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite (size, start1, size1, start2, size2);
+        std::memcpy (fifoData.data() + start1, record.data(), size_t (size1));
+        if (size2 > 0)
+            std::memcpy (fifoData.data() + start2, record.data() + size1, size_t (size2));
+        fifo.finishedWrite (size1 + size2);
+
+        // only values, that made it into the file, count as sent
+        std::copy (currentValues.begin(), currentValues.end(), lastValues.begin());
+    }
+
+    //==============================================================================
+    /** Reads a capture block by block, used by the replay tool */
+    class Reader
+    {
+    public:
+        struct Block
+        {
+            juce::int64 samplePosition = 0;
+            std::vector<std::pair<int, float>> changes;
+            juce::AudioBuffer<float> audio;
+        };
+
+        explicit Reader (const juce::File& file) : input (file)
+        {
+            if (! input.openedOk() || input.readInt() != magic || input.readInt() != version)
+                return;
+
+            sampleRate   = input.readDouble();
+            numChannels  = input.readInt();
+            maxBlockSize = input.readInt();
+
+            const auto numParameters = input.readInt();
+            if (! (sampleRate > 0 && juce::isPositiveAndNotGreaterThan (numChannels, maxChannels)
+                   && juce::isPositiveAndNotGreaterThan (maxBlockSize, maxBlockSizeLimit)
+                   && juce::isPositiveAndNotGreaterThan (numParameters, maxParameters)))
+                return;
+
+            for (int i = 0; i < numParameters && ! input.isExhausted(); ++i)
+                parameterIDs.add (input.readString());
+
+            valid = parameterIDs.size() == numParameters;
+        }
+
+        bool isValid() const { return valid; }
+
+        /** Returns false at the end of the file or if the block is truncated */
+        bool readNextBlock (Block& block)
+        {
+            if (! valid || input.getNumBytesRemaining() < juce::int64 (sizeof (juce::int64) + 3 * sizeof (juce::int32)))
+                return false;
+
+            block.samplePosition = input.readInt64();
+            const auto numSamples    = input.readInt();
+            const auto numRecorded   = input.readInt();
+            const auto numChanges    = input.readInt();
+
+            // the header sizes the buffers below, so a corrupt file must not get past this
+            if (numSamples <= 0 || numSamples > getBlockSizeLimit (maxBlockSize)
+                || numRecorded < 0 || numRecorded > numChannels
+                || numChanges < 0 || numChanges > parameterIDs.size())
+                return false;
+
+            block.changes.clear();
+            block.changes.reserve (size_t (numChanges));
+            for (int i = 0; i < numChanges; ++i)
+            {
+                const auto index = input.readInt();
+                const auto value = input.readFloat();
+                if (! juce::isPositiveAndBelow (index, parameterIDs.size()))
+                    return false;
+
+                block.changes.emplace_back (index, value);
+            }
+
+            block.audio.setSize (numChannels, numSamples, false, false, true);
+            block.audio.clear();
+            for (int channel = 0; channel < numRecorded; ++channel)
+            {
+                const auto numBytes = int (size_t (numSamples) * sizeof (float));
+                if (input.read (block.audio.getWritePointer (channel), numBytes) != numBytes)
+                    return false;
+            }
+
+            return true;
+        }
+
+        double            sampleRate   = 0.0;
+        int               numChannels  = 0;
+        int               maxBlockSize = 0;
+        juce::StringArray parameterIDs;
+
+    private:
+        juce::FileInputStream input;
+        bool valid = false;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Reader)
+    };
+
+    /** Blocks up to twice the announced size are recorded, some hosts exceed it */
+    static int getBlockSizeLimit (int announcedBlockSize)
+    {
+        return 2 * announcedBlockSize;
+    }
+
+    static juce::String getParameterID (juce::AudioProcessorParameter& parameter)
+    {
+        if (auto* withID = dynamic_cast<juce::AudioProcessorParameterWithID*> (&parameter))
+            return withID->paramID;
+
+        return juce::String (parameter.getParameterIndex());
+    }
+
+private:
+    /** The changes of a dropped block are lost, so the next record carries all values again */
+    void dropBlock()
+    {
+        numDroppedBlocks.fetch_add (1);
+        std::fill (lastValues.begin(), lastValues.end(), std::numeric_limits<float>::quiet_NaN());
+    }
+
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            writePendingBlocks();
+            wait (20);
+        }
+
+        writePendingBlocks();
+    }
+
+    void writePendingBlocks()
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead (fifo.getNumReady(), start1, size1, start2, size2);
+        if (size1 > 0)
+            stream->write (fifoData.data() + start1, size_t (size1));
+        if (size2 > 0)
+            stream->write (fifoData.data() + start2, size_t (size2));
+        fifo.finishedRead (size1 + size2);
+    }
+
+    std::atomic<bool> active { false };
+    std::atomic<int>  numDroppedBlocks { 0 };
+    juce::SpinLock    recordLock;
+
+    std::vector<juce::AudioProcessorParameter*> parameters;
+    int numChannels  = 0;
+    int maxBlockSize = 0;
+
+    // only used on the audio thread
+    std::vector<float> lastValues;
+    std::vector<float> currentValues;
+    std::vector<char>  record;
+    juce::int64        samplePosition = 0;
+
+    juce::AbstractFifo fifo { 1 };
+    std::vector<char>  fifoData;
+    std::unique_ptr<juce::FileOutputStream> stream;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AutomationCapture)
+};
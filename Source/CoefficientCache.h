@@ -0,0 +1,182 @@
+/*
+  ==============================================================================
+
+    This remembers filter designs of the Frequalizer bands
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+//==============================================================================
+/**
+    A fixed size, two way set associative cache of biquad designs. The key is the
+    filter type, the sample rate and the exact bits of frequency, quality and gain.
+    The parameters snap to their intervals, so looping automation and recalled
+    states hit the same keys again. Values a type doesn't use are left out of the
+    key, e.g. the gain of a low pass.
+
+    A hit is a hash and a compare, no trigonometry and no allocation. The entries
+    are guarded by a spin lock, that is only tried: if another thread holds it the
+    design is computed without the cache, so the audio thread never waits.
+*/
+class CoefficientCache
+{
+public:
+    static constexpr size_t numSets = 128;
+    static constexpr size_t numWays = 2;
+
+    /** b0, b1, b2, a1, a2 normalised by a0, like Snapshots::Biquad */
+    using Biquad = std::array<float, 5>;
+
+    using Design = Biquad (*) (int type, double sampleRate, float frequency, float quality, float gain);
+
+    /** Which parameters a filter type depends on */
+    enum Uses
+    {
+        UsesFrequency = 1,
+        UsesQuality   = 2,
+        UsesGain      = 4
+    };
+
+    using GetUses = int (*) (int type);
+
+    CoefficientCache (Design designToUse, GetUses getUsesToUse)
+      : design (designToUse), getUses (getUsesToUse)
+    {}
+
+    Biquad get (int type, double sampleRate, float frequency, float quality, float gain)
+    {
+        const auto key = makeKey (type, sampleRate, frequency, quality, gain);
+        auto& set = sets [size_t (hash (key) & (numSets - 1))];
+
+        {
+            const juce::SpinLock::ScopedTryLockType lock (setsLock);
+            if (lock.isLocked())
+            {
+                for (size_t way = 0; way < numWays; ++way)
+                {
+                    if (set.entries [way].valid && set.entries [way].key == key)
+                    {
+                        set.leastRecent = 1 - way;
+                        hits.fetch_add (1, std::memory_order_relaxed);
+                        return set.entries [way].coefficients;
+                    }
+                }
+            }
+        }
+
+        misses.fetch_add (1, std::memory_order_relaxed);
+        const auto coefficients = design (type, sampleRate, frequency, quality, gain);
+
+        const juce::SpinLock::ScopedTryLockType lock (setsLock);
+        if (lock.isLocked())
+        {
+            set.entries [set.leastRecent] = { key, coefficients, true };
+            set.leastRecent = 1 - set.leastRecent;
+        }
+
+        return coefficients;
+    }
+
+    void clear()
+    {
+        const juce::SpinLock::ScopedLockType lock (setsLock);
+        for (auto& set : sets)
+            for (auto& entry : set.entries)
+                entry.valid = false;
+    }
+
+    //==============================================================================
+    struct Statistics
+    {
+        juce::int64 hits   = 0;
+        juce::int64 misses = 0;
+
+        double getHitRate() const
+        {
+            return hits + misses > 0 ? double (hits) / double (hits + misses) : 0.0;
+        }
+    };
+
+    Statistics getStatistics() const
+    {
+        return { hits.load(), misses.load() };
+    }
+
+    void resetStatistics()
+    {
+        hits.store (0);
+        misses.store (0);
+    }
+
+private:
+    struct Key
+    {
+        juce::int32  type;
+        juce::uint32 frequency, quality, gain;
+        juce::uint64 sampleRate;
+
+        bool operator== (const Key& other) const
+        {
+            return type == other.type && frequency == other.frequency && quality == other.quality
+                && gain == other.gain && sampleRate == other.sampleRate;
+        }
+    };
+
+    struct Entry
+    {
+        Key    key {};
+        Biquad coefficients {};
+        bool   valid = false;
+    };
+
+    struct Set
+    {
+        std::array<Entry, numWays> entries;
+        size_t                     leastRecent = 0;
+    };
+
+    template <typename Value>
+    static auto toBits (Value value)
+    {
+        typename std::conditional<sizeof (Value) == 8, juce::uint64, juce::uint32>::type bits;
+        std::memcpy (&bits, &value, sizeof (bits));
+        return bits;
+    }
+
+    Key makeKey (int type, double sampleRate, float frequency, float quality, float gain) const
+    {
+        const auto uses = getUses (type);
+        return { juce::int32 (type),
+                 (uses & UsesFrequency) != 0 ? toBits (frequency) : 0u,
+                 (uses & UsesQuality)   != 0 ? toBits (quality)   : 0u,
+                 (uses & UsesGain)      != 0 ? toBits (gain)      : 0u,
+                 toBits (sampleRate) };
+    }
+
+    static juce::uint64 hash (const Key& key)
+    {
+        // the finaliser of splitmix64 spreads neighbouring frequencies over the sets
+        auto h = juce::uint64 (juce::uint32 (key.type)) * 0x9e3779b97f4a7c15ull;
+        h ^= (juce::uint64 (key.frequency) << 32) | key.quality;
+        h ^= juce::uint64 (key.gain) * 0xbf58476d1ce4e5b9ull;
+        h ^= key.sampleRate;
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+        return h ^ (h >> 31);
+    }
+
+    const Design  design;
+    const GetUses getUses;
+
+    juce::SpinLock                   setsLock;
+    std::array<Set, numSets>         sets;
+
+    std::atomic<juce::int64> hits   { 0 };
+    std::atomic<juce::int64> misses { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (CoefficientCache)
+};
@@ -7,8 +7,16 @@
 */
 
 #include "Analyser.h"
+#include "AutomationCapture.h"
+#include "CoefficientCache.h"
+#include "LoadMeter.h"
+#include "ResponseCurves.h"
+#include "SeqLock.h"
+#include "Snapshots.h"
+#include "UndoBudget.h"
 #include "FrequalizerProcessor.h"
 #include "SocialButtons.h"
+#include "Spectrogram.h"
 #include "FrequalizerEditor.h"
 
 static int   clickRadius = 4;
@@ -34,6 +42,12 @@ FrequalizerAudioProcessorEditor::FrequalizerAudioProcessorEditor (FrequalizerAud
     attachments.add (new juce::AudioProcessorValueTreeState::SliderAttachment (freqProcessor.getPluginState(), FrequalizerAudioProcessor::paramOutput, output));
     output.setTooltip (TRANS ("Overall Gain"));
 
+    addAndMakeVisible (morph);
+    morph.setRange (0.0, 1.0);
+    morph.setTooltip (TRANS ("Morph from snapshot A to B. Bands that change their type or on/off switch half way instead of crossfading"));
+    morph.setEnabled (freqProcessor.hasSnapshot (0) && freqProcessor.hasSnapshot (1));
+    morph.onValueChange = [this] { freqProcessor.morphSnapshots (0, 1, float (morph.getValue())); };
+
     auto size = freqProcessor.getSavedSize();
     setResizable (true, true);
     setSize (size.x, size.y);
@@ -42,19 +56,23 @@ FrequalizerAudioProcessorEditor::FrequalizerAudioProcessorEditor (FrequalizerAud
     updateFrequencyResponses();
 
 #ifdef JUCE_OPENGL
+    plotRenderer.setColours (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId),
+                             juce::Colours::greenyellow, juce::Colours::indianred);
+    openGLContext.setRenderer (&plotRenderer);
     openGLContext.attachTo (*getTopLevelComponent());
+    updateRendererArea();
 #endif
 
-    freqProcessor.addChangeListener (this);
-
-    startTimerHz (30);
+    updateRefreshSource (true);
 }
 
 FrequalizerAudioProcessorEditor::~FrequalizerAudioProcessorEditor()
 {
     juce::PopupMenu::dismissAllActiveMenus();
 
-    freqProcessor.removeChangeListener (this);
+    setDragGesture (false);
+    if (showLoadMeter)
+        freqProcessor.getLoadMeter().setEnabled (false);
 #ifdef JUCE_OPENGL
     openGLContext.detach();
 #endif
@@ -63,12 +81,199 @@ FrequalizerAudioProcessorEditor::~FrequalizerAudioProcessorEditor()
 //==============================================================================
 void FrequalizerAudioProcessorEditor::paint (juce::Graphics& g)
 {
+    FREQUALIZER_TRACE_SCOPE ("paint")
+    const auto paintStart = juce::Time::getMillisecondCounterHiRes();
+    const juce::ScopeGuard measurePaint { [this, paintStart]
+    {
+        frameStats.paintMs += 0.1 * (juce::Time::getMillisecondCounterHiRes() - paintStart - frameStats.paintMs);
+    }};
+
     const auto inputColour = juce::Colours::greenyellow;
     const auto outputColour = juce::Colours::indianred;
 
     juce::Graphics::ScopedSaveState state (g);
 
-    g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
+    const auto scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+    if (scale != layerScale)
+    {
+        layerScale = scale;
+        backgroundLayer = {};
+        bandsLayer = {};
+    }
+
+    if (! backgroundLayer.isValid())
+        backgroundLayer = createLayer (getLocalBounds(), [this] (juce::Graphics& lg) { paintBackground (lg); });
+
+    g.drawImage (backgroundLayer, getLocalBounds().toFloat());
+
+    g.reduceClipRegion (plotFrame);
+
+    // with OpenGL the renderer draws the spectrogram, below its traces
+    if (showSpectrogram && ! isUsingRenderer())
+        spectrogram.draw (g, plotFrame);
+
+    for (int view = 0; view < freqProcessor.getNumAnalyserViews(); ++view)
+    {
+        if (isUsingRenderer() || ! freqProcessor.isAnalyserViewVisible (view))
+            continue;
+
+        freqProcessor.createAnalyserPlot (analyserPath, plotFrame, 20.0f, true, view);
+        g.setColour (getAnalyserViewColour (inputColour, view));
+        g.strokePath (analyserPath, juce::PathStrokeType (1.0));
+        freqProcessor.createAnalyserPlot (analyserPath, plotFrame, 20.0f, false, view);
+        g.setColour (getAnalyserViewColour (outputColour, view));
+        g.strokePath (analyserPath, juce::PathStrokeType (1.0));
+    }
+
+    if (freqProcessor.getAnalyserVisibleViews() != (1u << Analyser<float>::SumView))
+    {
+        g.setFont (12.0f);
+        auto legend = plotFrame.reduced (8).withTrimmedTop (68).withHeight (14);
+        for (int view = 0; view < freqProcessor.getNumAnalyserViews(); ++view)
+        {
+            if (! freqProcessor.isAnalyserViewVisible (view))
+                continue;
+
+            g.setColour (getAnalyserViewColour (juce::Colours::silver, view));
+            g.drawFittedText (freqProcessor.getAnalyserViewName (view), legend, juce::Justification::topRight, 1);
+            legend.translate (0, 14);
+        }
+    }
+
+    const auto diagnostics = freqProcessor.getAnalyserDiagnostics();
+    if (diagnostics.droppedSamples > 0)
+    {
+        g.setFont (12.0f);
+        g.setColour (juce::Colours::red);
+        g.drawFittedText (TRANS ("Analyser dropped") + " " + juce::String (100.0 * diagnostics.droppedSamples / diagnostics.receivedSamples, 2) + " %",
+                          plotFrame.reduced (8, 48), juce::Justification::topRight, 1);
+    }
+
+    if (! bandsLayer.isValid())
+        bandsLayer = createLayer (plotFrame, [this] (juce::Graphics& lg) { paintBands (lg); });
+
+    g.drawImage (bandsLayer, plotFrame.toFloat());
+
+    if (showLoadMeter)
+        paintLoadMeter (g);
+}
+
+void FrequalizerAudioProcessorEditor::paintLoadMeter (juce::Graphics& g)
+{
+    const auto snapshot = freqProcessor.getLoadMeter().getSnapshot();
+    auto area = getLoadMeterArea();
+
+    g.setColour (juce::Colours::black.withAlpha (0.6f));
+    g.fillRoundedRectangle (area.toFloat(), 4.0f);
+    area.reduce (6, 4);
+
+    auto formatTime = [] (double nanos)
+    {
+        return nanos < 1000.0 ? juce::String (nanos, 0) + " ns" : juce::String (nanos / 1000.0, 1) + " us";
+    };
+
+    g.setFont (12.0f);
+    g.setColour (juce::Colours::silver);
+    g.drawText (TRANS ("DSP load") + " " + juce::String (100.0f * snapshot.averageLoad, 2) + " %, "
+                + TRANS ("peak") + " " + juce::String (100.0f * snapshot.peakLoad, 2) + " %",
+                area.removeFromTop (14), juce::Justification::left);
+
+    for (int section = 0; section < LoadMeter::NumSections; ++section)
+    {
+        const auto s = LoadMeter::Section (section);
+        g.drawText (juce::String (LoadMeter::getSectionName (s)) + ": "
+                    + formatTime (snapshot.averageNanosPerBlock [size_t (section)]) + " / "
+                    + TRANS ("block") + ", p99 " + formatTime (snapshot.getPercentile (s, LoadMeter::PerBlock, 0.99)) + ", "
+                    + formatTime (snapshot.getPercentile (s, LoadMeter::PerSample, 0.5)) + " / " + TRANS ("sample"),
+                    area.removeFromTop (14), juce::Justification::left);
+    }
+
+    g.drawText (TRANS ("Undo history") + " " + juce::File::descriptionOfSizeInBytes (freqProcessor.getUndoMemoryUse()) + ", "
+                + TRANS ("all instances") + " " + juce::File::descriptionOfSizeInBytes (freqProcessor.getTotalUndoMemoryUse()),
+                area.removeFromTop (14), juce::Justification::left);
+
+    g.drawText (TRANS ("Cache hits") + ": " + TRANS ("coefficients") + " "
+                + juce::String (100.0 * freqProcessor.getCoefficientCacheStatistics().getHitRate(), 1) + " %, "
+                + TRANS ("curves") + " " + juce::String (100.0 * freqProcessor.getResponseCacheStatistics().getHitRate(), 1) + " %",
+                area.removeFromTop (14), juce::Justification::left);
+
+    // histogram of the total time per block
+    const auto& bins = snapshot.histograms [LoadMeter::Total][LoadMeter::PerBlock];
+    const auto maxCount = *std::max_element (bins.begin(), bins.end());
+    if (maxCount == 0)
+        return;
+
+    auto first = 0, last = LoadMeter::numBins - 1;
+    while (bins [size_t (first)] == 0) ++first;
+    while (bins [size_t (last)] == 0) --last;
+
+    area.removeFromTop (4);
+    g.setColour (juce::Colours::silver.withAlpha (0.7f));
+    g.drawText (formatTime (LoadMeter::getBinStart (first)), area.removeFromLeft (50), juce::Justification::bottomLeft);
+    g.drawText (formatTime (LoadMeter::getBinStart (last + 1)), area.removeFromRight (50), juce::Justification::bottomRight);
+
+    const auto barWidth = float (area.getWidth()) / float (last - first + 1);
+    for (int bin = first; bin <= last; ++bin)
+    {
+        const auto height = float (area.getHeight()) * float (bins [size_t (bin)]) / float (maxCount);
+        g.fillRect (area.getX() + barWidth * float (bin - first), float (area.getBottom()) - height, std::max (barWidth - 1.0f, 1.0f), height);
+    }
+}
+
+void FrequalizerAudioProcessorEditor::saveTrace()
+{
+#if FREQUALIZER_TRACING
+    fileChooser = std::make_unique<juce::FileChooser> (TRANS ("Save Trace"),
+                                                       juce::File::getSpecialLocation (juce::File::userDesktopDirectory).getChildFile ("frequalizer-trace.json"),
+                                                       "*.json");
+    fileChooser->launchAsync (juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::canSelectFiles
+                                  | juce::FileBrowserComponent::warnAboutOverwriting,
+                              [] (const juce::FileChooser& chooser)
+                              {
+                                  if (chooser.getResult() != juce::File())
+                                      Tracing::Recorder::getInstance().writeChromeTrace (chooser.getResult());
+                              });
+#endif
+}
+
+void FrequalizerAudioProcessorEditor::toggleAutomationCapture()
+{
+    if (freqProcessor.isCapturingAutomation())
+    {
+        freqProcessor.stopAutomationCapture();
+        return;
+    }
+
+    fileChooser = std::make_unique<juce::FileChooser> (TRANS ("Capture Automation"),
+                                                       juce::File::getSpecialLocation (juce::File::userDesktopDirectory).getChildFile ("frequalizer.fqcapture"),
+                                                       "*.fqcapture");
+    fileChooser->launchAsync (juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::canSelectFiles
+                                  | juce::FileBrowserComponent::warnAboutOverwriting,
+                              [this] (const juce::FileChooser& chooser)
+                              {
+                                  if (chooser.getResult() != juce::File())
+                                      freqProcessor.startAutomationCapture (chooser.getResult());
+                              });
+}
+
+juce::Rectangle<int> FrequalizerAudioProcessorEditor::getLoadMeterArea() const
+{
+    return { plotFrame.getX() + 8, plotFrame.getBottom() - 28 - 124, 300, 124 };
+}
+
+void FrequalizerAudioProcessorEditor::paintBackground (juce::Graphics& g)
+{
+    const auto inputColour = juce::Colours::greenyellow;
+    const auto outputColour = juce::Colours::indianred;
+
+    {
+        // the OpenGL renderer draws the plot below the components
+        juce::Graphics::ScopedSaveState state (g);
+        if (isUsingRenderer())
+            g.excludeClipRegion (plotFrame);
+
+        g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
+    }
 
     auto logo = juce::ImageCache::getFromMemory (FFAudioData::LogoFF_png, FFAudioData::LogoFF_pngSize);
     g.drawImage (logo, brandingFrame.toFloat(), juce::RectanglePlacement (juce::RectanglePlacement::fillDestination));
@@ -98,33 +303,50 @@ void FrequalizerAudioProcessorEditor::paint (juce::Graphics& g)
     g.drawFittedText (" 0 dB", plotFrame.getX() + 3, juce::roundToInt (plotFrame.getY() + 2 + 0.5  * plotFrame.getHeight()), 50, 14, juce::Justification::left, 1);
     g.drawFittedText (juce::String (- maxDB / 2) + " dB", plotFrame.getX() + 3, juce::roundToInt (plotFrame.getY() + 2 + 0.75 * plotFrame.getHeight()), 50, 14, juce::Justification::left, 1);
 
-    g.reduceClipRegion (plotFrame);
-
     g.setFont (16.0f);
-    freqProcessor.createAnalyserPlot (analyserPath, plotFrame, 20.0f, true);
     g.setColour (inputColour);
     g.drawFittedText ("Input", plotFrame.reduced (8), juce::Justification::topRight, 1);
-    g.strokePath (analyserPath, juce::PathStrokeType (1.0));
-    freqProcessor.createAnalyserPlot (analyserPath, plotFrame, 20.0f, false);
     g.setColour (outputColour);
     g.drawFittedText ("Output", plotFrame.reduced (8, 28), juce::Justification::topRight, 1);
-    g.strokePath (analyserPath, juce::PathStrokeType (1.0));
+}
 
+void FrequalizerAudioProcessorEditor::paintBands (juce::Graphics& g)
+{
     for (size_t i=0; i < freqProcessor.getNumBands(); ++i) {
         auto* bandEditor = bandEditors.getUnchecked (int (i));
-        auto* band = freqProcessor.getBand (i);
+        const auto band   = freqProcessor.getBand (i);
+        const auto colour = freqProcessor.getBandColour (i);
 
-        g.setColour (band->active ? band->colour : band->colour.withAlpha (0.3f));
-        g.strokePath (bandEditor->frequencyResponse, juce::PathStrokeType (1.0));
-        g.setColour (draggingBand == int (i) ? band->colour : band->colour.withAlpha (0.3f));
-        auto x = juce::roundToInt (plotFrame.getX() + plotFrame.getWidth() * getPositionForFrequency (float (band->frequency)));
-        auto y = juce::roundToInt (getPositionForGain (float (band->gain), float (plotFrame.getY()), float (plotFrame.getBottom())));
+        if (! isUsingRenderer())
+        {
+            g.setColour (band.active ? colour : colour.withAlpha (0.3f));
+            g.strokePath (bandEditor->frequencyResponse, juce::PathStrokeType (1.0));
+        }
+        g.setColour (draggingBand == int (i) ? colour : colour.withAlpha (0.3f));
+        auto x = juce::roundToInt (plotFrame.getX() + plotFrame.getWidth() * getPositionForFrequency (float (band.frequency)));
+        auto y = juce::roundToInt (getPositionForGain (float (band.gain), float (plotFrame.getY()), float (plotFrame.getBottom())));
         g.drawVerticalLine (x, float (plotFrame.getY()), float (y - 5));
         g.drawVerticalLine (x, float (y + 5), float (plotFrame.getBottom()));
         g.fillEllipse (float (x - 3), float (y - 3), 6.0f, 6.0f);
     }
-    g.setColour (juce::Colours::silver);
-    g.strokePath (frequencyResponse, juce::PathStrokeType (1.0f));
+    if (! isUsingRenderer())
+    {
+        g.setColour (juce::Colours::silver);
+        g.strokePath (frequencyResponse, juce::PathStrokeType (1.0f));
+    }
+}
+
+juce::Image FrequalizerAudioProcessorEditor::createLayer (juce::Rectangle<int> area, std::function<void (juce::Graphics&)> painter) const
+{
+    juce::Image layer (juce::Image::ARGB,
+                       std::max (1, juce::roundToInt (area.getWidth() * layerScale)),
+                       std::max (1, juce::roundToInt (area.getHeight() * layerScale)), true);
+
+    juce::Graphics g (layer);
+    g.addTransform (juce::AffineTransform::translation (float (-area.getX()), float (-area.getY())).scaled (layerScale));
+    painter (g);
+
+    return layer;
 }
 
 void FrequalizerAudioProcessorEditor::resized()
@@ -141,55 +363,297 @@ void FrequalizerAudioProcessorEditor::resized()
 
     frame.setBounds (bandSpace.removeFromTop (bandSpace.getHeight() / 2));
     output.setBounds (frame.getBounds().reduced (8));
+    morph.setBounds (bandSpace.removeFromTop (30).reduced (8, 4));
 
     plotFrame.reduce (3, 3);
     brandingFrame = bandSpace.reduced (5);
 
+    spectrogram.setSize (plotFrame.getWidth(), spectrogramHistory);
+    freqProcessor.setResponseResolution (plotFrame.getWidth());
+
+    backgroundLayer = {};
+    bandsLayer = {};
+
     updateFrequencyResponses();
+    updateRendererArea();
 }
 
-void FrequalizerAudioProcessorEditor::changeListenerCallback (juce::ChangeBroadcaster* sender)
+void FrequalizerAudioProcessorEditor::timerCallback()
 {
-    ignoreUnused (sender);
-    updateFrequencyResponses();
-    repaint();
+    onFrame();
 }
 
-void FrequalizerAudioProcessorEditor::timerCallback()
+void FrequalizerAudioProcessorEditor::parentHierarchyChanged()
+{
+    updateRendererArea();
+}
+
+void FrequalizerAudioProcessorEditor::updateRefreshSource (bool occluded)
 {
-    if (freqProcessor.checkForNewAnalyserData())
+#if JUCE_MAJOR_VERSION >= 7
+    // the attachment only calls back while the editor is on a screen
+    juce::ignoreUnused (occluded);
+    if (vBlankAttachment == nullptr)
+        vBlankAttachment = std::make_unique<juce::VBlankAttachment> (this, [this] { onFrame(); });
+#else
+    // without vblank callbacks a slow timer only checks if the editor became visible again
+    const auto interval = occluded ? 250 : 16;
+    if (getTimerInterval() != interval)
+        startTimer (interval);
+#endif
+}
+
+FrequalizerAudioProcessorEditor::RefreshMode FrequalizerAudioProcessorEditor::getRefreshMode()
+{
+    auto* peer = getPeer();
+    if (peer == nullptr || peer->isMinimised() || ! isShowing())
+        return RefreshMode::Occluded;
+
+    if (draggingBand >= 0 && juce::ModifierKeys::currentModifiers.isAnyMouseButtonDown())
+        return RefreshMode::Interacting;
+
+    // keep the full rate a moment after the signal stopped, so the averaging can settle
+    const auto now = juce::Time::getMillisecondCounterHiRes();
+    if (freqProcessor.getAnalyserDiagnostics().peakLevel > juce::Decibels::decibelsToGain (-90.0f))
+        lastSignalTime = now;
+
+    return now - lastSignalTime < 2000.0 ? RefreshMode::Analysing : RefreshMode::Idle;
+}
+
+void FrequalizerAudioProcessorEditor::onFrame()
+{
+    FREQUALIZER_TRACE_SCOPE ("onFrame")
+    const auto start = juce::Time::getMillisecondCounterHiRes();
+    const auto mode  = getRefreshMode();
+
+    static constexpr double intervals[] = { 0.0, 1000.0 / 5.0, 1000.0 / 30.0, 0.0 };
+    const auto interval = intervals [int (mode)];
+
+    if ((mode == RefreshMode::Occluded) != (frameStats.mode == RefreshMode::Occluded))
+        updateRefreshSource (mode == RefreshMode::Occluded);
+
+    frameStats.mode = mode;
+    if (mode == RefreshMode::Occluded)
+        return;
+
+    // changed curves are picked up on every callback, the interval only throttles the analyser
+    if (const auto changedBands = freqProcessor.fetchChangedBands())
+    {
+        const auto damage = updateFrequencyResponses (changedBands);
+        bandsLayer = {};
+        repaint (damage);
+    }
+
+    // the handle of a dragged band follows the mouse with every frame, the curve with the next update
+    applyPendingDrag();
+    if (mode == RefreshMode::Interacting && juce::isPositiveAndBelow (draggingBand, bandEditors.size()))
+    {
+        auto* bandEditor = bandEditors [draggingBand];
+        const auto handleArea = getBandHandleArea (size_t (draggingBand));
+        if (handleArea != bandEditor->handleArea)
+        {
+            repaint (bandEditor->handleArea.getUnion (handleArea));
+            bandEditor->handleArea = handleArea;
+            bandsLayer = {};
+        }
+    }
+
+    if (start - lastFrameTime < interval - 2.0)
+        return;
+
+    if (lastFrameTime > 0.0)
+        frameStats.rate += 0.1 * (1000.0 / std::max (start - lastFrameTime, 1.0) - frameStats.rate);
+
+    lastFrameTime = start;
+
+#ifdef JUCE_OPENGL
+    if (rendererActive != plotRenderer.isActive())
+    {
+        rendererActive = plotRenderer.isActive();
+        backgroundLayer = {};
+        bandsLayer = {};
+        repaint();
+    }
+#endif
+
+    // a silent analyser changes nothing, only the scrolling spectrogram still needs repainting
+    const auto analyserChanged    = freqProcessor.checkForNewAnalyserData();
+    const auto spectrogramChanged = showSpectrogram && updateSpectrogram();
+
+    if (analyserChanged || spectrogramChanged)
+    {
         repaint (plotFrame);
+    }
+    else if (showLoadMeter)
+    {
+        repaint (getLoadMeterArea());
+    }
+
+    const auto duration = juce::Time::getMillisecondCounterHiRes() - start;
+    ++frameStats.numFrames;
+    frameStats.frameMs += 0.1 * (duration - frameStats.frameMs);
+    frameStats.maxFrameMs = std::max (frameStats.maxFrameMs, duration);
+}
+
+FrequalizerAudioProcessorEditor::FrameStats FrequalizerAudioProcessorEditor::getFrameStats() const
+{
+    return frameStats;
+}
+
+bool FrequalizerAudioProcessorEditor::updateSpectrogram()
+{
+    // one line per analysed frame keeps the time axis even, if the timer was late
+    const auto frames = freqProcessor.getAnalyserDiagnostics().analysedFrames;
+    const auto first  = std::max (lastSpectrogramFrame, frames - Analyser<float>::frameHistoryLength);
+    lastSpectrogramFrame = frames;
+
+    auto added = false;
+    for (auto frameIndex = first; frameIndex < frames; ++frameIndex)
+    {
+        if (! freqProcessor.getAnalyserFrameLevels (spectrogramMap, spectrogramLevels, spectrogram.getNumPixels(), 20.0f, false, frameIndex))
+            continue;
+
+        BinToPixelMap::toDecibels (spectrogramLevels.data(), spectrogram.getNumPixels(), -80.0f);
+        spectrogram.addLine (spectrogramLevels.data(), -80.0f, 0.0f);
+        added = true;
+    }
+
+    return added;
 }
 
 void FrequalizerAudioProcessorEditor::mouseDown (const juce::MouseEvent& e)
 {
-    if (! e.mods.isPopupMenu() || ! plotFrame.contains (e.x, e.y))
+    if (! plotFrame.contains (e.x, e.y))
         return;
 
+    if (! e.mods.isPopupMenu())
+    {
+        setDragGesture (true);
+        return;
+    }
+
     for (int i=0; i < bandEditors.size(); ++i)
     {
-        if (auto* band = freqProcessor.getBand (size_t (i)))
+        const auto band = freqProcessor.getBand (size_t (i));
+        if (std::abs (plotFrame.getX() + getPositionForFrequency (float (int (band.frequency)) * plotFrame.getWidth())
+                      - e.position.getX()) < clickRadius)
         {
-            if (std::abs (plotFrame.getX() + getPositionForFrequency (float (int (band->frequency)) * plotFrame.getWidth())
-                          - e.position.getX()) < clickRadius)
-            {
-                contextMenu.clear();
-                const auto& names = FrequalizerAudioProcessor::getFilterTypeNames();
-                for (int t=0; t < names.size(); ++t)
-                    contextMenu.addItem (t + 1, names [t], true, band->type == t);
-
-                contextMenu.showMenuAsync (juce::PopupMenu::Options()
-                                           .withTargetComponent (this)
-                                           .withTargetScreenArea ({e.getScreenX(), e.getScreenY(), 1, 1})
-                                           , [this, i](int selected)
-                                           {
-                                               if (selected > 0)
-                                                   bandEditors.getUnchecked (i)->setType (selected - 1);
-                                           });
-                return;
-            }
+            contextMenu.clear();
+            const auto& names = FrequalizerAudioProcessor::getFilterTypeNames();
+            for (int t=0; t < names.size(); ++t)
+                contextMenu.addItem (t + 1, names [t], true, band.type == t);
+
+            contextMenu.showMenuAsync (juce::PopupMenu::Options()
+                                       .withTargetComponent (this)
+                                       .withTargetScreenArea ({e.getScreenX(), e.getScreenY(), 1, 1})
+                                       , [this, i](int selected)
+                                       {
+                                           if (selected > 0)
+                                               bandEditors.getUnchecked (i)->setType (selected - 1);
+                                       });
+            return;
         }
     }
+
+    showAnalyserMenu (e);
+}
+
+void FrequalizerAudioProcessorEditor::showAnalyserMenu (const juce::MouseEvent& e)
+{
+    using Mode = Analyser<float>::AveragingMode;
+
+    const auto mode = freqProcessor.getAnalyserAveragingMode();
+    const auto time = freqProcessor.getAnalyserAveragingTime();
+    const float times[] = { 0.1f, 0.3f, 1.0f, 3.0f };
+
+    juce::PopupMenu timeMenu;
+    for (int i=0; i < juce::numElementsInArray (times); ++i)
+        timeMenu.addItem (10 + i, juce::String (times [i], 1) + " s", true,
+                          mode == Mode::Exponential && juce::approximatelyEqual (time, times [i]));
+
+    contextMenu.clear();
+    contextMenu.addSectionHeader (TRANS ("Analyser Averaging"));
+    contextMenu.addSubMenu (TRANS ("Exponential"), timeMenu, true, nullptr, mode == Mode::Exponential);
+    contextMenu.addItem (2, TRANS ("Long Term Average"), true, mode == Mode::Infinite);
+    contextMenu.addItem (3, TRANS ("Peak Hold"), true, mode == Mode::PeakHold);
+    contextMenu.addSeparator();
+    contextMenu.addItem (4, TRANS ("Reset Averaging"));
+    contextMenu.addItem (5, TRANS ("Show Spectrogram"), true, showSpectrogram);
+    contextMenu.addItem (6, TRANS ("Show DSP Load"), true, showLoadMeter);
+#if FREQUALIZER_TRACING
+    contextMenu.addItem (7, TRANS ("Save Trace..."));
+#endif
+    contextMenu.addItem (8, TRANS ("Capture Automation..."), true, freqProcessor.isCapturingAutomation());
+
+    juce::PopupMenu viewMenu;
+    for (int view = 0; view < freqProcessor.getNumAnalyserViews(); ++view)
+        viewMenu.addItem (100 + view, freqProcessor.getAnalyserViewName (view), true, freqProcessor.isAnalyserViewVisible (view));
+
+    contextMenu.addSectionHeader (TRANS ("Analyser Channels"));
+    contextMenu.addSubMenu (TRANS ("Show"), viewMenu);
+
+    juce::PopupMenu snapshotMenu;
+    for (int slot = 0; slot < FrequalizerAudioProcessor::numSnapshots; ++slot)
+        snapshotMenu.addItem (200 + slot, TRANS ("Store") + " " + juce::String::charToString (juce::juce_wchar ('A' + slot)));
+    snapshotMenu.addSeparator();
+    for (int slot = 0; slot < FrequalizerAudioProcessor::numSnapshots; ++slot)
+        snapshotMenu.addItem (210 + slot, TRANS ("Play") + " " + juce::String::charToString (juce::juce_wchar ('A' + slot)), freqProcessor.hasSnapshot (slot));
+    snapshotMenu.addItem (220, TRANS ("Back to Parameters"), freqProcessor.isPlayingSnapshots());
+
+    contextMenu.addSectionHeader (TRANS ("Compare"));
+    contextMenu.addSubMenu (TRANS ("Snapshots"), snapshotMenu);
+
+    contextMenu.showMenuAsync (juce::PopupMenu::Options()
+                               .withTargetComponent (this)
+                               .withTargetScreenArea ({e.getScreenX(), e.getScreenY(), 1, 1})
+                               , [this, times](int selected)
+                               {
+                                   if (juce::isPositiveAndBelow (selected - 10, juce::numElementsInArray (times)))
+                                   {
+                                       freqProcessor.setAnalyserAveragingTime (times [selected - 10]);
+                                       freqProcessor.setAnalyserAveragingMode (Mode::Exponential);
+                                   }
+                                   else if (selected == 2)
+                                       freqProcessor.setAnalyserAveragingMode (Mode::Infinite);
+                                   else if (selected == 3)
+                                       freqProcessor.setAnalyserAveragingMode (Mode::PeakHold);
+                                   else if (selected == 4)
+                                       freqProcessor.resetAnalyserAveraging();
+                                   else if (selected == 5)
+                                   {
+                                       showSpectrogram = ! showSpectrogram;
+#ifdef JUCE_OPENGL
+                                       plotRenderer.setSpectrogram (showSpectrogram ? &spectrogram : nullptr);
+#endif
+                                       repaint (plotFrame);
+                                   }
+                                   else if (selected == 6)
+                                   {
+                                       showLoadMeter = ! showLoadMeter;
+                                       freqProcessor.getLoadMeter().setEnabled (showLoadMeter);
+                                       freqProcessor.getLoadMeter().reset();
+                                       repaint (getLoadMeterArea());
+                                   }
+                                   else if (selected == 7)
+                                       saveTrace();
+                                   else if (selected == 8)
+                                       toggleAutomationCapture();
+                                   else if (juce::isPositiveAndBelow (selected - 100, freqProcessor.getNumAnalyserViews()))
+                                   {
+                                       // the legend changes, even if a silent analyser doesn't
+                                       freqProcessor.setAnalyserVisibleViews (freqProcessor.getAnalyserVisibleViews() ^ (1u << (selected - 100)));
+                                       repaint (plotFrame);
+                                   }
+                                   else if (juce::isPositiveAndBelow (selected - 200, FrequalizerAudioProcessor::numSnapshots))
+                                   {
+                                       freqProcessor.storeSnapshot (selected - 200);
+                                       morph.setEnabled (freqProcessor.hasSnapshot (0) && freqProcessor.hasSnapshot (1));
+                                   }
+                                   else if (juce::isPositiveAndBelow (selected - 210, FrequalizerAudioProcessor::numSnapshots))
+                                       freqProcessor.recallSnapshot (selected - 210);
+                                   else if (selected == 220)
+                                       freqProcessor.releaseSnapshots();
+                               });
 }
 
 void FrequalizerAudioProcessorEditor::mouseMove (const juce::MouseEvent& e)
@@ -198,87 +662,193 @@ void FrequalizerAudioProcessorEditor::mouseMove (const juce::MouseEvent& e)
     {
         for (int i=0; i < bandEditors.size(); ++i)
         {
-            if (auto* band = freqProcessor.getBand (size_t (i)))
+            const auto band = freqProcessor.getBand (size_t (i));
+            auto pos = plotFrame.getX() + getPositionForFrequency (float (band.frequency)) * plotFrame.getWidth();
+
+            if (std::abs (pos - e.position.getX()) < clickRadius)
             {
-                auto pos = plotFrame.getX() + getPositionForFrequency (float (band->frequency)) * plotFrame.getWidth();
+                if (std::abs (getPositionForGain (float (band.gain), float (plotFrame.getY()), float (plotFrame.getBottom()))
+                              - e.position.getY()) < clickRadius)
+                {
+                    draggingGain = freqProcessor.getPluginState().getParameter (freqProcessor.getGainParamName (size_t (i)));
+                    setMouseCursor (juce::MouseCursor (juce::MouseCursor::UpDownLeftRightResizeCursor));
+                }
+                else
+                {
+                    setMouseCursor (juce::MouseCursor (juce::MouseCursor::LeftRightResizeCursor));
+                }
 
-                if (std::abs (pos - e.position.getX()) < clickRadius)
+                if (i != draggingBand)
                 {
-                    if (std::abs (getPositionForGain (float (band->gain), float (plotFrame.getY()), float (plotFrame.getBottom()))
-                                  - e.position.getY()) < clickRadius)
-                    {
-                        draggingGain = freqProcessor.getPluginState().getParameter (freqProcessor.getGainParamName (size_t (i)));
-                        setMouseCursor (juce::MouseCursor (juce::MouseCursor::UpDownLeftRightResizeCursor));
-                    }
-                    else
-                    {
-                        setMouseCursor (juce::MouseCursor (juce::MouseCursor::LeftRightResizeCursor));
-                    }
-
-                    if (i != draggingBand)
-                    {
-                        draggingBand = i;
-                        repaint (plotFrame);
-                    }
-                    return;
+                    if (draggingBand >= 0)
+                        repaint (bandEditors [draggingBand]->handleArea);
+
+                    draggingBand = i;
+                    bandsLayer = {};
+                    repaint (bandEditors [draggingBand]->handleArea);
                 }
+                return;
             }
         }
     }
+    if (draggingBand < 0)
+        return;
+
+    // only the highlighted handle changes, when the mouse leaves it
+    bandsLayer = {};
+    repaint (bandEditors [draggingBand]->handleArea);
+
     draggingBand = -1;
     draggingGain = false;
     setMouseCursor (juce::MouseCursor (juce::MouseCursor::NormalCursor));
-    repaint (plotFrame);
 }
 
 void FrequalizerAudioProcessorEditor::mouseDrag (const juce::MouseEvent& e)
 {
+    // mice can send events much faster than the display refreshes, only the last one is used
     if (juce::isPositiveAndBelow (draggingBand, bandEditors.size()))
     {
-        auto pos = (e.position.getX() - plotFrame.getX()) / plotFrame.getWidth();
-        bandEditors [draggingBand]->setFrequency (getFrequencyForPosition (pos));
-        if (draggingGain)
-            bandEditors [draggingBand]->setGain (getGainForPosition (e.position.getY(), float (plotFrame.getY()), float (plotFrame.getBottom())));
+        dragPosition = e.position;
+        dragPending  = true;
     }
 }
 
+void FrequalizerAudioProcessorEditor::mouseUp (const juce::MouseEvent& e)
+{
+    ignoreUnused (e);
+    applyPendingDrag();
+    setDragGesture (false);
+}
+
+void FrequalizerAudioProcessorEditor::setDragGesture (bool isStarting)
+{
+    for (auto* parameter : gestureParameters)
+        parameter->endChangeGesture();
+
+    gestureParameters.clear();
+
+    if (! isStarting || ! juce::isPositiveAndBelow (draggingBand, bandEditors.size()))
+        return;
+
+    auto& pluginState = freqProcessor.getPluginState();
+    gestureParameters.add (pluginState.getParameter (freqProcessor.getFrequencyParamName (size_t (draggingBand))));
+    if (draggingGain)
+        gestureParameters.add (pluginState.getParameter (freqProcessor.getGainParamName (size_t (draggingBand))));
+
+    gestureParameters.removeAllInstancesOf (nullptr);
+
+    // the processor starts a new undo transaction with each gesture
+    for (auto* parameter : gestureParameters)
+        parameter->beginChangeGesture();
+}
+
+void FrequalizerAudioProcessorEditor::applyPendingDrag()
+{
+    if (! std::exchange (dragPending, false) || ! juce::isPositiveAndBelow (draggingBand, bandEditors.size()))
+        return;
+
+    auto pos = (dragPosition.getX() - plotFrame.getX()) / plotFrame.getWidth();
+    bandEditors [draggingBand]->setFrequency (getFrequencyForPosition (pos));
+    if (draggingGain)
+        bandEditors [draggingBand]->setGain (getGainForPosition (dragPosition.getY(), float (plotFrame.getY()), float (plotFrame.getBottom())));
+}
+
 void FrequalizerAudioProcessorEditor::mouseDoubleClick (const juce::MouseEvent& e)
 {
     if (plotFrame.contains (e.x, e.y))
     {
         for (size_t i=0; i < size_t (bandEditors.size()); ++i)
         {
-            if (auto* band = freqProcessor.getBand (i))
+            const auto band = freqProcessor.getBand (i);
+            if (std::abs (plotFrame.getX() + getPositionForFrequency (float (band.frequency)) * plotFrame.getWidth()
+                          - e.position.getX()) < clickRadius)
             {
-                if (std::abs (plotFrame.getX() + getPositionForFrequency (float (band->frequency)) * plotFrame.getWidth()
-                              - e.position.getX()) < clickRadius)
-                {
-                    if (auto* param = freqProcessor.getPluginState().getParameter (freqProcessor.getActiveParamName (i)))
-                        param->setValueNotifyingHost (param->getValue() < 0.5f ? 1.0f : 0.0f);
-                }
+                if (auto* param = freqProcessor.getPluginState().getParameter (freqProcessor.getActiveParamName (i)))
+                    param->setValueNotifyingHost (param->getValue() < 0.5f ? 1.0f : 0.0f);
             }
         }
     }
 }
 
-void FrequalizerAudioProcessorEditor::updateFrequencyResponses ()
+juce::Rectangle<int> FrequalizerAudioProcessorEditor::updateFrequencyResponses (juce::uint32 bandsToUpdate)
 {
     auto pixelsPerDouble = 2.0f * plotFrame.getHeight() / juce::Decibels::decibelsToGain (maxDB);
 
+    // the damage covers the old and the new position of everything, that moved
+    auto damage = frequencyResponse.getBounds();
+
     for (int i=0; i < bandEditors.size(); ++i)
     {
         auto* bandEditor = bandEditors.getUnchecked (i);
 
-        if (auto* band = freqProcessor.getBand (size_t (i)))
+        if ((bandsToUpdate & (1u << i)) != 0)
         {
-            bandEditor->updateControls (band->type);
+            damage = damage.getUnion (bandEditor->frequencyResponse.getBounds())
+                           .getUnion (bandEditor->handleArea.toFloat());
+
+            bandEditor->updateControls (freqProcessor.getBand (size_t (i)).type);
             bandEditor->frequencyResponse.clear();
-            freqProcessor.createFrequencyPlot (bandEditor->frequencyResponse, band->magnitudes, plotFrame.withX (plotFrame.getX() + 1), pixelsPerDouble);
+            freqProcessor.getFrequencyResponse (i, bandEditor->response);
+            freqProcessor.createFrequencyPlot (bandEditor->frequencyResponse, bandEditor->response, plotFrame.withX (plotFrame.getX() + 1), pixelsPerDouble);
+            bandEditor->handleArea = getBandHandleArea (size_t (i));
+
+            damage = damage.getUnion (bandEditor->frequencyResponse.getBounds())
+                           .getUnion (bandEditor->handleArea.toFloat());
         }
         bandEditor->updateSoloState (freqProcessor.getBandSolo (i));
     }
     frequencyResponse.clear();
-    freqProcessor.createFrequencyPlot (frequencyResponse, freqProcessor.getMagnitudes(), plotFrame, pixelsPerDouble);
+    freqProcessor.getFrequencyResponse (-1, overallResponse);
+    freqProcessor.createFrequencyPlot (frequencyResponse, overallResponse, plotFrame, pixelsPerDouble);
+    damage = damage.getUnion (frequencyResponse.getBounds());
+
+#ifdef JUCE_OPENGL
+    std::vector<PlotRenderer::Curve> curves;
+    for (size_t i=0; i < freqProcessor.getNumBands(); ++i)
+    {
+        const auto colour = freqProcessor.getBandColour (i);
+        curves.push_back ({ bandEditors.getUnchecked (int (i))->response, freqProcessor.getBand (i).active ? colour : colour.withAlpha (0.3f) });
+    }
+
+    curves.push_back ({ overallResponse, juce::Colours::silver });
+    plotRenderer.setResponseCurves (std::move (curves));
+#endif
+
+    // the strokes are one pixel wide and may be anti-aliased into the neighbours
+    return damage.getSmallestIntegerContainer().expanded (2).getIntersection (plotFrame);
+}
+
+juce::Rectangle<int> FrequalizerAudioProcessorEditor::getBandHandleArea (size_t index)
+{
+    if (index >= freqProcessor.getNumBands())
+        return {};
+
+    auto x = juce::roundToInt (plotFrame.getX() + plotFrame.getWidth() * getPositionForFrequency (freqProcessor.getBand (index).frequency));
+    return { x - 4, plotFrame.getY(), 9, plotFrame.getHeight() };
+}
+
+void FrequalizerAudioProcessorEditor::updateRendererArea()
+{
+#ifdef JUCE_OPENGL
+    if (auto* target = openGLContext.getTargetComponent())
+        plotRenderer.setPlotArea (target->getLocalArea (this, plotFrame), target->getWidth(), target->getHeight());
+    else
+        plotRenderer.setPlotArea (plotFrame, getWidth(), getHeight());
+#endif
+}
+
+bool FrequalizerAudioProcessorEditor::isUsingRenderer() const
+{
+#ifdef JUCE_OPENGL
+    return rendererActive;
+#else
+    return false;
+#endif
+}
+
+juce::Colour FrequalizerAudioProcessorEditor::getAnalyserViewColour (juce::Colour base, int view)
+{
+    return view == Analyser<float>::SumView ? base : base.withRotatedHue (0.12f * view).withMultipliedAlpha (0.8f);
 }
 
 float FrequalizerAudioProcessorEditor::getPositionForFrequency (float freq)
@@ -436,3 +1006,258 @@ void FrequalizerAudioProcessorEditor::BandEditor::buttonClicked (juce::Button* b
         processor.setBandSolo (solo.getToggleState() ? int (index) : -1);
     }
 }
+
+#ifdef JUCE_OPENGL
+//==============================================================================
+static const char* plotVertexShader =
+    "attribute float position;\n"
+    "attribute float value;\n"
+    "uniform vec2 xTransform;\n"
+    "uniform vec2 yTransform;\n"
+    "uniform float logarithmic;\n"
+    "uniform float log2Values;\n"
+    "void main()\n"
+    "{\n"
+    "    float p = mix (position, log2 (max (position, 1.0e-3)), logarithmic);\n"
+    "    float v = mix (log2 (max (value, 1.0e-6)), value, log2Values);\n"
+    "    float x = xTransform.x + xTransform.y * p;\n"
+    "    float y = yTransform.x + yTransform.y * v;\n"
+    "    gl_Position = vec4 (2.0 * x - 1.0, 2.0 * clamp (y, -0.1, 1.1) - 1.0, 0.0, 1.0);\n"
+    "}\n";
+
+static const char* plotFragmentShader =
+    "uniform vec4 colour;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_FragColor = colour;\n"
+    "}\n";
+
+FrequalizerAudioProcessorEditor::PlotRenderer::PlotRenderer (FrequalizerAudioProcessor& p, juce::OpenGLContext& c)
+  : processor (p),
+    context (c)
+{
+}
+
+void FrequalizerAudioProcessorEditor::PlotRenderer::setColours (juce::Colour background, juce::Colour input, juce::Colour output)
+{
+    const juce::SpinLock::ScopedLockType lock (dataLock);
+    backgroundColour = background;
+    inputColour      = input;
+    outputColour     = output;
+}
+
+void FrequalizerAudioProcessorEditor::PlotRenderer::setPlotArea (juce::Rectangle<int> area, int targetWidth, int targetHeight)
+{
+    const juce::SpinLock::ScopedLockType lock (dataLock);
+    plotArea = area;
+    width    = targetWidth;
+    height   = targetHeight;
+}
+
+void FrequalizerAudioProcessorEditor::PlotRenderer::setSpectrogram (const Spectrogram* spectrogramToDraw)
+{
+    const juce::SpinLock::ScopedLockType lock (dataLock);
+    spectrogram = spectrogramToDraw;
+}
+
+void FrequalizerAudioProcessorEditor::PlotRenderer::setResponseCurves (std::vector<Curve> curves)
+{
+    {
+        const juce::SpinLock::ScopedLockType lock (dataLock);
+        std::swap (responseCurves, curves);
+    }
+    context.triggerRepaint();
+}
+
+bool FrequalizerAudioProcessorEditor::PlotRenderer::isActive() const
+{
+    return active.load();
+}
+
+void FrequalizerAudioProcessorEditor::PlotRenderer::newOpenGLContextCreated()
+{
+    using namespace ::juce::gl;
+
+    auto program = std::make_unique<juce::OpenGLShaderProgram> (context);
+    if (! program->addVertexShader (juce::OpenGLHelpers::translateVertexShaderToV3 (plotVertexShader))
+        || ! program->addFragmentShader (juce::OpenGLHelpers::translateFragmentShaderToV3 (plotFragmentShader))
+        || ! program->link())
+    {
+        DBG ("Plot shader failed: " << program->getLastError());
+        return;
+    }
+
+    shader      = std::move (program);
+    xTransform  = std::make_unique<juce::OpenGLShaderProgram::Uniform> (*shader, "xTransform");
+    yTransform  = std::make_unique<juce::OpenGLShaderProgram::Uniform> (*shader, "yTransform");
+    logarithmic = std::make_unique<juce::OpenGLShaderProgram::Uniform> (*shader, "logarithmic");
+    log2Values  = std::make_unique<juce::OpenGLShaderProgram::Uniform> (*shader, "log2Values");
+    colour      = std::make_unique<juce::OpenGLShaderProgram::Uniform> (*shader, "colour");
+    position    = std::make_unique<juce::OpenGLShaderProgram::Attribute> (*shader, "position");
+    value       = std::make_unique<juce::OpenGLShaderProgram::Attribute> (*shader, "value");
+
+    glGenBuffers (1, &vertexBuffer);
+    active.store (true);
+}
+
+void FrequalizerAudioProcessorEditor::PlotRenderer::renderOpenGL()
+{
+    using namespace ::juce::gl;
+
+    juce::Rectangle<int> area;
+    int targetWidth, targetHeight;
+    const Spectrogram* spectrogramToDraw;
+    juce::Colour background, input, output;
+    {
+        const juce::SpinLock::ScopedLockType lock (dataLock);
+        area              = plotArea;
+        targetWidth       = width;
+        targetHeight      = height;
+        spectrogramToDraw = spectrogram;
+        background        = backgroundColour;
+        input             = inputColour;
+        output            = outputColour;
+    }
+
+    juce::OpenGLHelpers::clear (background);
+
+    if (shader == nullptr || area.isEmpty())
+        return;
+
+    const auto scale = float (context.getRenderingScale());
+    const auto viewport = juce::Rectangle<int> (juce::roundToInt (area.getX() * scale),
+                                                juce::roundToInt ((targetHeight - area.getBottom()) * scale),
+                                                juce::roundToInt (area.getWidth() * scale),
+                                                juce::roundToInt (area.getHeight() * scale));
+
+    if (spectrogramToDraw != nullptr)
+    {
+        if (spectrogramToDraw->copyIfChanged (spectrogramImage, spectrogramVersion))
+            spectrogramTexture.loadImage (spectrogramImage);
+
+        // copyTexture works in pixels from the top left of the whole target and stretches the texture
+        const auto target = (area.toFloat() * scale).getSmallestIntegerContainer();
+        glViewport (0, 0, juce::roundToInt (targetWidth * scale), juce::roundToInt (targetHeight * scale));
+        spectrogramTexture.bind();
+        context.copyTexture (target, target, juce::roundToInt (targetWidth * scale), juce::roundToInt (targetHeight * scale), false);
+        spectrogramTexture.unbind();
+    }
+
+    glViewport (viewport.getX(), viewport.getY(), viewport.getWidth(), viewport.getHeight());
+    glEnable (GL_SCISSOR_TEST);
+    glScissor (viewport.getX(), viewport.getY(), viewport.getWidth(), viewport.getHeight());
+    glEnable (GL_BLEND);
+    glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glLineWidth (scale);
+
+    shader->use();
+    glBindBuffer (GL_ARRAY_BUFFER, vertexBuffer);
+    glVertexAttribPointer (GLuint (position->attributeID), 1, GL_FLOAT, GL_FALSE, 2 * sizeof (float), nullptr);
+    glVertexAttribPointer (GLuint (value->attributeID), 1, GL_FLOAT, GL_FALSE, 2 * sizeof (float), (GLvoid*) sizeof (float));
+    glEnableVertexAttribArray (GLuint (position->attributeID));
+    glEnableVertexAttribArray (GLuint (value->attributeID));
+
+    for (int view = 0; view < processor.getNumAnalyserViews(); ++view)
+    {
+        if (! processor.isAnalyserViewVisible (view))
+            continue;
+
+        drawAnalyser (true,  view, getAnalyserViewColour (input, view), false);
+        drawAnalyser (false, view, getAnalyserViewColour (output, view), view == Analyser<float>::SumView);
+    }
+
+    {
+        // curves are y = 0.5 + 2 / maxGain * log2 (magnitude), the same as createFrequencyPlot
+        const juce::SpinLock::ScopedLockType lock (dataLock);
+        for (const auto& curve : responseCurves)
+            drawCurve (curve.log2Magnitudes, curve.colour,
+                       0.0f, 1.0f / float (curve.log2Magnitudes.size()), false,
+                       0.5f, 2.0f / juce::Decibels::decibelsToGain (maxDB), true, false);
+    }
+
+    glDisableVertexAttribArray (GLuint (position->attributeID));
+    glDisableVertexAttribArray (GLuint (value->attributeID));
+    glBindBuffer (GL_ARRAY_BUFFER, 0);
+    glDisable (GL_SCISSOR_TEST);
+}
+
+void FrequalizerAudioProcessorEditor::PlotRenderer::drawAnalyser (bool input, int view, juce::Colour traceColour, bool fill)
+{
+    const auto binWidth = processor.getAnalyserBins (bins, input, view);
+    if (binWidth <= 0.0f)
+        return;
+
+    // x = log2 (bin * binWidth / 20 Hz) / 10, y = (gainToDecibels (bin) + 80) / 80
+    drawCurve (bins, traceColour,
+               std::log2 (binWidth / 20.0f) / 10.0f, 0.1f, true,
+               1.0f, 0.25f / std::log2 (10.0f), false, fill);
+}
+
+void FrequalizerAudioProcessorEditor::PlotRenderer::drawCurve (const std::vector<float>& values, juce::Colour curveColour,
+                                                                float xOffset, float xScale, bool logarithmicX,
+                                                                float yOffset, float yScale, bool valuesAreLog2, bool fill)
+{
+    using namespace ::juce::gl;
+
+    if (values.size() < 2)
+        return;
+
+    xTransform->set (xOffset, xScale);
+    yTransform->set (yOffset, yScale);
+    logarithmic->set (logarithmicX ? 1.0f : 0.0f);
+    log2Values->set (valuesAreLog2 ? 1.0f : 0.0f);
+
+    const auto numPoints = values.size();
+
+    if (fill)
+    {
+        // a triangle strip alternating between the curve and the bottom
+        vertices.resize (numPoints * 4);
+        for (size_t i = 0; i < numPoints; ++i)
+        {
+            vertices [4 * i]     = float (i);
+            vertices [4 * i + 1] = values [i];
+            vertices [4 * i + 2] = float (i);
+            vertices [4 * i + 3] = 0.0f;
+        }
+
+        glBufferData (GL_ARRAY_BUFFER, GLsizeiptr (vertices.size() * sizeof (float)), vertices.data(), GL_STREAM_DRAW);
+        colour->set (curveColour.getFloatRed(), curveColour.getFloatGreen(), curveColour.getFloatBlue(), curveColour.getFloatAlpha() * 0.15f);
+        glDrawArrays (GL_TRIANGLE_STRIP, 0, GLsizei (numPoints * 2));
+    }
+
+    vertices.resize (numPoints * 2);
+    for (size_t i = 0; i < numPoints; ++i)
+    {
+        vertices [2 * i]     = float (i);
+        vertices [2 * i + 1] = values [i];
+    }
+
+    glBufferData (GL_ARRAY_BUFFER, GLsizeiptr (vertices.size() * sizeof (float)), vertices.data(), GL_STREAM_DRAW);
+    colour->set (curveColour.getFloatRed(), curveColour.getFloatGreen(), curveColour.getFloatBlue(), curveColour.getFloatAlpha());
+    glDrawArrays (GL_LINE_STRIP, 0, GLsizei (numPoints));
+}
+
+void FrequalizerAudioProcessorEditor::PlotRenderer::openGLContextClosing()
+{
+    using namespace ::juce::gl;
+
+    active.store (false);
+
+    spectrogramTexture.release();
+    spectrogramVersion = 0;
+
+    if (vertexBuffer != 0)
+        glDeleteBuffers (1, &vertexBuffer);
+
+    vertexBuffer = 0;
+    position.reset();
+    value.reset();
+    xTransform.reset();
+    yTransform.reset();
+    logarithmic.reset();
+    log2Values.reset();
+    colour.reset();
+    shader.reset();
+}
+#endif
@@ -17,7 +17,6 @@
 /**
 */
 class FrequalizerAudioProcessorEditor  : public juce::AudioProcessorEditor,
-                                         public juce::ChangeListener,
                                          public juce::Timer
 {
 public:
@@ -28,16 +27,44 @@ public:
 
     void paint (juce::Graphics&) override;
     void resized() override;
-    void changeListenerCallback (juce::ChangeBroadcaster* sender) override;
     void timerCallback() override;
 
     void mouseDown (const juce::MouseEvent& e) override;
 
     void mouseMove (const juce::MouseEvent& e) override;
     void mouseDrag (const juce::MouseEvent& e) override;
+    void mouseUp (const juce::MouseEvent& e) override;
 
     void mouseDoubleClick (const juce::MouseEvent& e) override;
 
+    void parentHierarchyChanged() override;
+
+    //==============================================================================
+
+    /** The editor refreshes as fast as the display while the user drags in the plot, at
+        a moderate rate while the analyser shows a signal, slowly when the input is silent
+        and not at all when it is not showing. The analyser is only repainted, when a frame
+        changed its average. */
+    enum class RefreshMode
+    {
+        Occluded = 0,
+        Idle,
+        Analysing,
+        Interacting
+    };
+
+    struct FrameStats
+    {
+        juce::int64 numFrames = 0;
+        RefreshMode mode      = RefreshMode::Occluded;
+        double      rate      = 0.0;    // measured frames per second
+        double      frameMs   = 0.0;    // average time spent in the frame callback
+        double      maxFrameMs = 0.0;
+        double      paintMs   = 0.0;    // average time spent in paint()
+    };
+
+    FrameStats getFrameStats() const;
+
     //==============================================================================
 
     class BandEditor : public juce::Component,
@@ -60,7 +87,9 @@ public:
 
         void buttonClicked (juce::Button* b) override;
 
-        juce::Path frequencyResponse;
+        std::vector<float>   response;
+        juce::Path           frequencyResponse;
+        juce::Rectangle<int> handleArea;
     private:
         JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BandEditor)
 
@@ -79,9 +108,122 @@ public:
         juce::OwnedArray<juce::AudioProcessorValueTreeState::ButtonAttachment> buttonAttachments;
     };
 
+#ifdef JUCE_OPENGL
+    //==============================================================================
+    /**
+        Draws the analyser traces and the response curves natively. The analyser bins and the
+        magnitudes are uploaded as vertex buffers, the mapping to the logarithmic frequency axis
+        and to decibels happens in the vertex shader, so the CPU work per frame doesn't depend
+        on the size of the window. The spectrogram is uploaded as texture and drawn below.
+
+        The shaders only need OpenGL 2.1 or ES 2, so Mesa's software rasteriser runs them as
+        well, e.g. on a headless machine. Without OpenGL or if the shader fails, the editor
+        paints the plot with juce::Graphics.
+    */
+    class PlotRenderer : public juce::OpenGLRenderer
+    {
+    public:
+        PlotRenderer (FrequalizerAudioProcessor& processor, juce::OpenGLContext& context);
+
+        struct Curve
+        {
+            std::vector<float> log2Magnitudes;
+            juce::Colour       colour;
+        };
+
+        void setColours (juce::Colour background, juce::Colour input, juce::Colour output);
+
+        void setPlotArea (juce::Rectangle<int> area, int targetWidth, int targetHeight);
+
+        /** Sets the spectrogram to draw below the traces, or nullptr to hide it */
+        void setSpectrogram (const Spectrogram* spectrogramToDraw);
+
+        void setResponseCurves (std::vector<Curve> curves);
+
+        bool isActive() const;
+
+        void newOpenGLContextCreated() override;
+        void renderOpenGL() override;
+        void openGLContextClosing() override;
+
+    private:
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PlotRenderer)
+
+        void drawAnalyser (bool input, int view, juce::Colour colour, bool fill);
+
+        void drawCurve (const std::vector<float>& values, juce::Colour colour,
+                        float xOffset, float xScale, bool logarithmic,
+                        float yOffset, float yScale, bool valuesAreLog2, bool fill);
+
+        FrequalizerAudioProcessor& processor;
+        juce::OpenGLContext&       context;
+
+        std::unique_ptr<juce::OpenGLShaderProgram>          shader;
+        std::unique_ptr<juce::OpenGLShaderProgram::Uniform> xTransform, yTransform, logarithmic, log2Values, colour;
+        std::unique_ptr<juce::OpenGLShaderProgram::Attribute> position, value;
+        juce::uint32 vertexBuffer = 0;
+        std::atomic<bool> active { false };
+
+        juce::SpinLock        dataLock;
+        juce::Rectangle<int>  plotArea;
+        int                   width  = 0;
+        int                   height = 0;
+        const Spectrogram*    spectrogram = nullptr;
+        std::vector<Curve>    responseCurves;
+        juce::Colour          backgroundColour, inputColour, outputColour;
+
+        // only used on the OpenGL thread
+        std::vector<float>    bins;
+        std::vector<float>    vertices;
+        juce::Image           spectrogramImage;
+        juce::uint32          spectrogramVersion = 0;
+        juce::OpenGLTexture   spectrogramTexture;
+    };
+#endif
+
 private:
 
-    void updateFrequencyResponses ();
+    /** Recomputes the curves of the bands flagged in bandsToUpdate and the overall response.
+        Returns the area, that needs repainting. */
+    juce::Rectangle<int> updateFrequencyResponses (juce::uint32 bandsToUpdate = ~0u);
+
+    juce::Rectangle<int> getBandHandleArea (size_t index);
+
+    void applyPendingDrag();
+
+    /** Tells the host and the undo history, that a drag on the plot starts or ends */
+    void setDragGesture (bool isStarting);
+
+    void updateRendererArea();
+
+    bool isUsingRenderer() const;
+
+    void paintBackground (juce::Graphics& g);
+
+    void paintBands (juce::Graphics& g);
+
+    void paintLoadMeter (juce::Graphics& g);
+
+    juce::Rectangle<int> getLoadMeterArea() const;
+
+    void saveTrace();
+
+    void toggleAutomationCapture();
+
+    juce::Image createLayer (juce::Rectangle<int> area, std::function<void (juce::Graphics&)> painter) const;
+
+    void showAnalyserMenu (const juce::MouseEvent& e);
+
+    /** Adds the frames analysed since the last call, returns true if any line was added */
+    bool updateSpectrogram();
+
+    void updateRefreshSource (bool occluded);
+
+    void onFrame();
+
+    RefreshMode getRefreshMode();
+
+    static juce::Colour getAnalyserViewColour (juce::Colour base, int view);
 
     static float getPositionForFrequency (float freq);
 
@@ -99,6 +241,8 @@ private:
 
 #ifdef JUCE_OPENGL
     juce::OpenGLContext     openGLContext;
+    PlotRenderer            plotRenderer { freqProcessor, openGLContext };
+    bool                    rendererActive = false;
 #endif
 
     juce::OwnedArray<BandEditor>  bandEditors;
@@ -106,19 +250,51 @@ private:
     juce::Rectangle<int>          plotFrame;
     juce::Rectangle<int>          brandingFrame;
 
+    std::vector<float>            overallResponse;
     juce::Path                    frequencyResponse;
     juce::Path                    analyserPath;
 
+    // static parts are cached, the background is invalidated in resized(), the bands on change
+    juce::Image                   backgroundLayer;
+    juce::Image                   bandsLayer;
+    float                         layerScale = 1.0f;
+
+    static constexpr int          spectrogramHistory = 256;
+    Spectrogram                   spectrogram;
+    BinToPixelMap                 spectrogramMap;
+    std::vector<float>            spectrogramLevels;
+    juce::int64                   lastSpectrogramFrame = 0;
+    bool                          showSpectrogram = false;
+    bool                          showLoadMeter = false;
+
     juce::GroupComponent          frame;
     juce::Slider                  output { juce::Slider::RotaryHorizontalVerticalDrag, juce::Slider::TextBoxBelow };
 
+    // morphs between the snapshots A and B, enabled once both are stored
+    juce::Slider                  morph  { juce::Slider::LinearHorizontal, juce::Slider::NoTextBox };
+
     SocialButtons                 socialButtons;
 
     int                           draggingBand = -1;
     bool                          draggingGain = false;
 
+    // drag events are collected and applied once per frame
+    juce::Point<float>            dragPosition;
+    bool                          dragPending = false;
+
+    // the parameters of the running drag gesture
+    juce::Array<juce::AudioProcessorParameter*> gestureParameters;
+
     juce::OwnedArray<juce::AudioProcessorValueTreeState::SliderAttachment> attachments;
     juce::SharedResourcePointer<juce::TooltipWindow> tooltipWindow;
 
     juce::PopupMenu               contextMenu;
+    std::unique_ptr<juce::FileChooser> fileChooser;
+
+#if JUCE_MAJOR_VERSION >= 7
+    std::unique_ptr<juce::VBlankAttachment> vBlankAttachment;
+#endif
+    double                        lastFrameTime = 0.0;
+    double                        lastSignalTime = 0.0;
+    FrameStats                    frameStats;
 };
@@ -7,8 +7,17 @@
 */
 
 #include "Analyser.h"
+#include "AutomationCapture.h"
+#include "CoefficientCache.h"
+#include "LoadMeter.h"
+#include "RealtimeCheck.h"
+#include "ResponseCurves.h"
+#include "SeqLock.h"
+#include "Snapshots.h"
+#include "UndoBudget.h"
 #include "FrequalizerProcessor.h"
 #include "SocialButtons.h"
+#include "Spectrogram.h"
 #include "FrequalizerEditor.h"
 
 
@@ -26,7 +35,7 @@ namespace IDs
     juce::String sizeY  {"size-y"};
 }
 
-juce::String FrequalizerAudioProcessor::getBandID (size_t index)
+static const char* getBandIDText (size_t index)
 {
     switch (index)
     {
@@ -41,24 +50,46 @@ juce::String FrequalizerAudioProcessor::getBandID (size_t index)
     return "unknown";
 }
 
+juce::String FrequalizerAudioProcessor::getBandID (size_t index)
+{
+    return getBandIDText (index);
+}
+
 int FrequalizerAudioProcessor::getBandIndexFromID (juce::String paramID)
 {
+    // called for automation on the audio thread, so no temporary strings
     for (size_t i=0; i < 6; ++i)
-        if (paramID.startsWith (getBandID (i) + "-"))
+    {
+        const auto* bandID = getBandIDText (i);
+        const auto length  = int (std::strlen (bandID));
+        if (paramID.startsWith (bandID) && paramID [length] == '-')
             return int (i);
+    }
 
     return -1;
 }
 
-std::vector<FrequalizerAudioProcessor::Band> createDefaultBands()
+std::vector<FrequalizerAudioProcessor::BandInfo> createBandInfos()
 {
-    std::vector<FrequalizerAudioProcessor::Band> defaults;
-    defaults.push_back (FrequalizerAudioProcessor::Band (TRANS ("Lowest"),    juce::Colours::blue,   FrequalizerAudioProcessor::HighPass,    20.0f, 0.707f));
-    defaults.push_back (FrequalizerAudioProcessor::Band (TRANS ("Low"),       juce::Colours::brown,  FrequalizerAudioProcessor::LowShelf,   250.0f, 0.707f));
-    defaults.push_back (FrequalizerAudioProcessor::Band (TRANS ("Low Mids"),  juce::Colours::green,  FrequalizerAudioProcessor::Peak,       500.0f, 0.707f));
-    defaults.push_back (FrequalizerAudioProcessor::Band (TRANS ("High Mids"), juce::Colours::coral,  FrequalizerAudioProcessor::Peak,      1000.0f, 0.707f));
-    defaults.push_back (FrequalizerAudioProcessor::Band (TRANS ("High"),      juce::Colours::orange, FrequalizerAudioProcessor::HighShelf, 5000.0f, 0.707f));
-    defaults.push_back (FrequalizerAudioProcessor::Band (TRANS ("Highest"),   juce::Colours::red,    FrequalizerAudioProcessor::LowPass,  12000.0f, 0.707f));
+    std::vector<FrequalizerAudioProcessor::BandInfo> infos;
+    infos.push_back ({ TRANS ("Lowest"),    juce::Colours::blue   });
+    infos.push_back ({ TRANS ("Low"),       juce::Colours::brown  });
+    infos.push_back ({ TRANS ("Low Mids"),  juce::Colours::green  });
+    infos.push_back ({ TRANS ("High Mids"), juce::Colours::coral  });
+    infos.push_back ({ TRANS ("High"),      juce::Colours::orange });
+    infos.push_back ({ TRANS ("Highest"),   juce::Colours::red    });
+    return infos;
+}
+
+FrequalizerAudioProcessor::BandParameters createDefaultBands()
+{
+    FrequalizerAudioProcessor::BandParameters defaults;
+    defaults [0] = { FrequalizerAudioProcessor::HighPass,    20.0f, 0.707f };
+    defaults [1] = { FrequalizerAudioProcessor::LowShelf,   250.0f, 0.707f };
+    defaults [2] = { FrequalizerAudioProcessor::Peak,       500.0f, 0.707f };
+    defaults [3] = { FrequalizerAudioProcessor::Peak,      1000.0f, 0.707f };
+    defaults [4] = { FrequalizerAudioProcessor::HighShelf, 5000.0f, 0.707f };
+    defaults [5] = { FrequalizerAudioProcessor::LowPass,  12000.0f, 0.707f };
     return defaults;
 }
 
@@ -69,6 +100,7 @@ juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout()
     // setting defaults
     const float maxGain = juce::Decibels::decibelsToGain (24.0f);
     auto defaults = createDefaultBands();
+    const auto infos = createBandInfos();
 
     {
         auto param = std::make_unique<juce::AudioParameterFloat> (FrequalizerAudioProcessor::paramOutput, TRANS ("Output"),
@@ -130,7 +162,7 @@ juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout()
                                                                    [](float value, int) {return value > 0.5f ? TRANS ("active") : TRANS ("bypassed");},
                                                                    [](juce::String text) {return text == TRANS ("active");});
 
-        auto group = std::make_unique<juce::AudioProcessorParameterGroup> ("band" + juce::String (i), defaults [i].name, "|",
+        auto group = std::make_unique<juce::AudioProcessorParameterGroup> ("band" + juce::String (i), infos [i].name, "|",
                                                                      std::move (typeParameter),
                                                                      std::move (freqParameter),
                                                                      std::move (qltyParameter),
@@ -151,21 +183,12 @@ FrequalizerAudioProcessor::FrequalizerAudioProcessor() :
                     .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
                     ),
 #endif
-state (*this, &undo, "PARAMS", createParameterLayout())
+state (*this, &undo, "PARAMS", createParameterLayout()),
+bandInfos (createBandInfos()),
+bands (createDefaultBands())
 {
-    frequencies.resize (300);
-    for (size_t i=0; i < frequencies.size(); ++i) {
-        frequencies [i] = 20.0 * std::pow (2.0, i / 30.0);
-    }
-    magnitudes.resize (frequencies.size());
-
-    // needs to be in sync with the ProcessorChain filter
-    bands = createDefaultBands();
-
-    for (size_t i = 0; i < bands.size(); ++i)
+    for (size_t i = 0; i < numBands; ++i)
     {
-        bands [i].magnitudes.resize (frequencies.size(), 1.0);
-
         state.addParameterListener (getTypeParamName (i), this);
         state.addParameterListener (getFrequencyParamName (i), this);
         state.addParameterListener (getQualityParamName (i), this);
@@ -174,14 +197,32 @@ state (*this, &undo, "PARAMS", createParameterLayout())
     }
 
     state.addParameterListener (paramOutput, this);
+    outputGain = state.getRawParameterValue (paramOutput);
+
+    // the responses thread designs the bands from the published settings
+    responses.designBand = [this] (int index, double rate)
+    {
+        const auto band = getBand (size_t (index));
+        return makeBiquad (band.type, rate, band.frequency, band.quality, band.gain);
+    };
+
+    // each gesture becomes one undo transaction
+    for (auto* parameter : getParameters())
+        parameter->addListener (this);
+
+    undoBudget->add (undo);
 
     state.state = juce::ValueTree (JucePlugin_Name);
 }
 
 FrequalizerAudioProcessor::~FrequalizerAudioProcessor()
 {
-    inputAnalyser.stopThread (1000);
-    outputAnalyser.stopThread (1000);
+    for (auto* parameter : getParameters())
+        parameter->removeListener (this);
+
+    undoBudget->remove (undo);
+    capture.stop();
+    analyser.stopThread (1000);
 }
 
 //==============================================================================
@@ -252,23 +293,32 @@ void FrequalizerAudioProcessor::prepareToPlay (double newSampleRate, int newSamp
     spec.maximumBlockSize = juce::uint32 (newSamplesPerBlock);
     spec.numChannels = juce::uint32 (getTotalNumOutputChannels ());
 
-    for (size_t i=0; i < bands.size(); ++i) {
-        updateBand (i);
-    }
+    responses.setSampleRate (sampleRate);
+    snapshots.setSampleRate (sampleRate);
+
     filter.get<6>().setGainLinear (*state.getRawParameterValue (paramOutput));
+    for (size_t i = 0; i < numBands; ++i)
+        getFilterState (i).coefficients.ensureStorageAllocated (int (std::tuple_size<Snapshots::Biquad>::value));
 
-    updatePlots();
+    updateAllBands();
 
     filter.prepare (spec);
+    loadMeter.prepare (sampleRate);
 
-    inputAnalyser.setupAnalyser  (int (sampleRate), float (sampleRate));
-    outputAnalyser.setupAnalyser (int (sampleRate), float (sampleRate));
+    // the analyser covers the audible range at 44.1 or 48 kHz, so 88.2 and 96 kHz are decimated
+    // by 2, 176.4 and 192 kHz by 4. The half-band stages need a power of two, 144 kHz uses 2.
+    const auto decimation = juce::nextPowerOfTwo (std::max (1, int (std::floor (sampleRate / 44100.0))) + 1) / 2;
+    analyser.setupAnalyser (int (sampleRate), float (sampleRate), getTotalNumInputChannels(), decimation);
 }
 
 void FrequalizerAudioProcessor::releaseResources()
 {
-    inputAnalyser.stopThread (1000);
-    outputAnalyser.stopThread (1000);
+    analyser.stopThread (1000);
+}
+
+void FrequalizerAudioProcessor::reset()
+{
+    filter.reset();
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -284,22 +334,54 @@ bool FrequalizerAudioProcessor::isBusesLayoutSupported (const BusesLayout& layou
 
 void FrequalizerAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
+    FREQUALIZER_TRACE_SCOPE ("processBlock")
+    const RealtimeCheck::Scope realtimeScope;
+    const LoadMeter::ScopedBlock measureBlock (loadMeter, buffer.getNumSamples());
     juce::ScopedNoDenormals noDenormals;
     juce::ignoreUnused (midiMessages);
 
-    if (getActiveEditor() != nullptr)
-        inputAnalyser.addAudioData (buffer, 0, getTotalNumInputChannels());
+    capture.recordBlock (buffer);
 
-    if (wasBypassed) {
-        filter.reset();
-        wasBypassed = false;
+    const auto analyse = getActiveEditor() != nullptr;
+
+    if (analyse)
+    {
+        const LoadMeter::ScopedSection measure (loadMeter, LoadMeter::AnalyserFeed);
+        analyser.addAudioData (buffer, 0, getTotalNumInputChannels(), AnalyserInput);
     }
-    juce::dsp::AudioBlock<float>              ioBuffer (buffer);
-    juce::dsp::ProcessContextReplacing<float> context  (ioBuffer);
-    filter.process (context);
 
-    if (getActiveEditor() != nullptr)
-        outputAnalyser.addAudioData (buffer, 0, getTotalNumOutputChannels());
+    {
+        const LoadMeter::ScopedSection measure (loadMeter, LoadMeter::Filter);
+        if (wasBypassed) {
+            filter.reset();
+            wasBypassed = false;
+        }
+        applyPendingCoefficients();
+
+        juce::dsp::AudioBlock<float>              ioBuffer (buffer);
+        if (snapshots.isEngaged())
+            processSnapshots (ioBuffer);
+        else
+        {
+            const auto current = bands.load();
+            juce::uint32 activeBands = 0;
+            for (size_t i = 0; i < numBands; ++i)
+                if (current [i].active)
+                    activeBands |= 1u << i;
+
+            updateBypassedStates (activeBands);
+            filter.get<6>().setGainLinear (outputGain->load());
+
+            juce::dsp::ProcessContextReplacing<float> context  (ioBuffer);
+            filter.process (context);
+        }
+    }
+
+    if (analyse)
+    {
+        const LoadMeter::ScopedSection measure (loadMeter, LoadMeter::AnalyserFeed);
+        analyser.addAudioData (buffer, 0, getTotalNumOutputChannels(), AnalyserOutput);
+    }
 }
 
 juce::AudioProcessorValueTreeState& FrequalizerAudioProcessor::getPluginState()
@@ -335,50 +417,70 @@ juce::String FrequalizerAudioProcessor::getActiveParamName (size_t index)
 void FrequalizerAudioProcessor::parameterChanged (const juce::String& parameter, float newValue)
 {
     if (parameter == paramOutput) {
-        filter.get<6>().setGainLinear (newValue);
-        updatePlots();
+        juce::ignoreUnused (newValue);
+
+        // the audio thread picks the gain up from the parameter, or from the live snapshot
+        snapshots.updateLive (getSnapshotSettings());
+        if (! restoringState)
+            updatePlots();
         return;
     }
 
     int index = getBandIndexFromID (parameter);
-    if (juce::isPositiveAndBelow (index, bands.size()))
+    if (juce::isPositiveAndBelow (index, numBands))
     {
-        auto* band = getBand (size_t (index));
-        if (parameter.endsWith (paramType)) {
-            band->type = static_cast<FilterType> (static_cast<int> (newValue));
-        }
-        else if (parameter.endsWith (paramFrequency)) {
-            band->frequency = newValue;
-        }
-        else if (parameter.endsWith (paramQuality)) {
-            band->quality = newValue;
-        }
-        else if (parameter.endsWith (paramGain)) {
-            band->gain = newValue;
-        }
-        else if (parameter.endsWith (paramActive)) {
-            band->active = newValue >= 0.5f;
-        }
+        bands.modify ([&] (BandParameters& parameters)
+        {
+            auto& band = parameters [size_t (index)];
+            if (parameter.endsWith (paramType)) {
+                band.type = static_cast<FilterType> (static_cast<int> (newValue));
+            }
+            else if (parameter.endsWith (paramFrequency)) {
+                band.frequency = newValue;
+            }
+            else if (parameter.endsWith (paramQuality)) {
+                band.quality = newValue;
+            }
+            else if (parameter.endsWith (paramGain)) {
+                band.gain = newValue;
+            }
+            else if (parameter.endsWith (paramActive)) {
+                band.active = newValue >= 0.5f;
+            }
+        });
 
-        updateBand (size_t (index));
+        // a restored state rebuilds all bands once at the end
+        if (! restoringState)
+            updateBand (size_t (index));
     }
 }
 
+void FrequalizerAudioProcessor::parameterValueChanged (int, float)
+{
+}
+
+void FrequalizerAudioProcessor::parameterGestureChanged (int, bool gestureIsStarting)
+{
+    // the ValueTree is only written on the message thread, so the undo manager lives there
+    if (gestureIsStarting && juce::MessageManager::existsAndIsCurrentThread())
+        undo.beginNewTransaction();
+}
+
 size_t FrequalizerAudioProcessor::getNumBands () const
 {
-    return bands.size();
+    return numBands;
 }
 
 juce::String FrequalizerAudioProcessor::getBandName   (size_t index) const
 {
-    if (juce::isPositiveAndBelow (index, bands.size()))
-        return bands [size_t (index)].name;
+    if (juce::isPositiveAndBelow (index, bandInfos.size()))
+        return bandInfos [index].name;
     return TRANS ("unknown");
 }
 juce::Colour FrequalizerAudioProcessor::getBandColour (size_t index) const
 {
-    if (juce::isPositiveAndBelow (index, bands.size()))
-        return bands [size_t (index)].colour;
+    if (juce::isPositiveAndBelow (index, bandInfos.size()))
+        return bandInfos [index].colour;
     return juce::Colours::silver;
 }
 
@@ -390,35 +492,28 @@ bool FrequalizerAudioProcessor::getBandSolo (int index) const
 void FrequalizerAudioProcessor::setBandSolo (int index)
 {
     soloed = index;
-    updateBypassedStates();
+    updatePlots();
 }
 
-void FrequalizerAudioProcessor::updateBypassedStates ()
+void FrequalizerAudioProcessor::updateBypassedStates (juce::uint32 activeBands)
 {
-    if (juce::isPositiveAndBelow (soloed, bands.size())) {
-        filter.setBypassed<0>(soloed != 0);
-        filter.setBypassed<1>(soloed != 1);
-        filter.setBypassed<2>(soloed != 2);
-        filter.setBypassed<3>(soloed != 3);
-        filter.setBypassed<4>(soloed != 4);
-        filter.setBypassed<5>(soloed != 5);
-    }
-    else {
-        filter.setBypassed<0>(!bands[0].active);
-        filter.setBypassed<1>(!bands[1].active);
-        filter.setBypassed<2>(!bands[2].active);
-        filter.setBypassed<3>(!bands[3].active);
-        filter.setBypassed<4>(!bands[4].active);
-        filter.setBypassed<5>(!bands[5].active);
-    }
-    updatePlots();
+    // the bypass flags of the chain are only written here, on the audio thread
+    const auto solo = soloed.load (std::memory_order_relaxed);
+    for (size_t i = 0; i < numBands; ++i)
+        setBandBypassed (i, juce::isPositiveAndBelow (solo, numBands) ? int (i) != solo
+                                                                      : (activeBands & (1u << i)) == 0);
+}
+
+FrequalizerAudioProcessor::Band FrequalizerAudioProcessor::getBand (size_t index) const
+{
+    if (juce::isPositiveAndBelow (index, numBands))
+        return bands.load() [index];
+    return {};
 }
 
-FrequalizerAudioProcessor::Band* FrequalizerAudioProcessor::getBand (size_t index)
+FrequalizerAudioProcessor::BandParameters FrequalizerAudioProcessor::getBands() const
 {
-    if (juce::isPositiveAndBelow (index, bands.size()))
-        return &bands [index];
-    return nullptr;
+    return bands.load();
 }
 
 juce::StringArray FrequalizerAudioProcessor::getFilterTypeNames()
@@ -439,96 +534,182 @@ juce::StringArray FrequalizerAudioProcessor::getFilterTypeNames()
     };
 }
 
+namespace
+{
+    Snapshots::Biquad normaliseBiquad (const std::array<float, 6>& raw)
+    {
+        // the same normalisation as juce::dsp::IIR::Coefficients, so both designs are identical
+        const auto a0Inv = ! juce::approximatelyEqual (raw [3], 0.0f) ? 1.0f / raw [3] : 0.0f;
+        return { raw [0] * a0Inv, raw [1] * a0Inv, raw [2] * a0Inv, raw [4] * a0Inv, raw [5] * a0Inv };
+    }
+
+    Snapshots::Biquad normaliseBiquad (const std::array<float, 4>& raw)
+    {
+        const auto a0Inv = ! juce::approximatelyEqual (raw [2], 0.0f) ? 1.0f / raw [2] : 0.0f;
+        return { raw [0] * a0Inv, raw [1] * a0Inv, 0.0f, raw [3] * a0Inv, 0.0f };
+    }
+}
+
+Snapshots::Biquad FrequalizerAudioProcessor::makeBiquad (FilterType type, double rate, float frequency, float quality, float gain)
+{
+    using ArrayCoefficients = juce::dsp::IIR::ArrayCoefficients<float>;
+
+    switch (type) {
+        case LowPass:     return normaliseBiquad (ArrayCoefficients::makeLowPass (rate, frequency, quality));
+        case LowPass1st:  return normaliseBiquad (ArrayCoefficients::makeFirstOrderLowPass (rate, frequency));
+        case LowShelf:    return normaliseBiquad (ArrayCoefficients::makeLowShelf (rate, frequency, quality, gain));
+        case BandPass:    return normaliseBiquad (ArrayCoefficients::makeBandPass (rate, frequency, quality));
+        case AllPass:     return normaliseBiquad (ArrayCoefficients::makeAllPass (rate, frequency, quality));
+        case AllPass1st:  return normaliseBiquad (ArrayCoefficients::makeFirstOrderAllPass (rate, frequency));
+        case Notch:       return normaliseBiquad (ArrayCoefficients::makeNotch (rate, frequency, quality));
+        case Peak:        return normaliseBiquad (ArrayCoefficients::makePeakFilter (rate, frequency, quality, gain));
+        case HighShelf:   return normaliseBiquad (ArrayCoefficients::makeHighShelf (rate, frequency, quality, gain));
+        case HighPass1st: return normaliseBiquad (ArrayCoefficients::makeFirstOrderHighPass (rate, frequency));
+        case HighPass:    return normaliseBiquad (ArrayCoefficients::makeHighPass (rate, frequency, quality));
+        case NoFilter:
+        case LastFilterID:
+        default:          return { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    }
+}
+
+int FrequalizerAudioProcessor::getFilterUses (FilterType type)
+{
+    switch (type) {
+        case LowPass1st:
+        case AllPass1st:
+        case HighPass1st:
+            return CoefficientCache::UsesFrequency;
+        case LowPass:
+        case BandPass:
+        case AllPass:
+        case Notch:
+        case HighPass:
+            return CoefficientCache::UsesFrequency | CoefficientCache::UsesQuality;
+        case LowShelf:
+        case Peak:
+        case HighShelf:
+            return CoefficientCache::UsesFrequency | CoefficientCache::UsesQuality | CoefficientCache::UsesGain;
+        case NoFilter:
+        case LastFilterID:
+        default:
+            return 0;
+    }
+}
+
 void FrequalizerAudioProcessor::updateBand (const size_t index)
 {
+    FREQUALIZER_TRACE_SCOPE ("updateBand")
     if (sampleRate > 0) {
-        juce::dsp::IIR::Coefficients<float>::Ptr newCoefficients;
-        switch (bands [index].type) {
-            case NoFilter:
-                newCoefficients = new juce::dsp::IIR::Coefficients<float> (1, 0, 1, 0);
-                break;
-            case LowPass:
-                newCoefficients = juce::dsp::IIR::Coefficients<float>::makeLowPass (sampleRate, bands [index].frequency, bands [index].quality);
-                break;
-            case LowPass1st:
-                newCoefficients = juce::dsp::IIR::Coefficients<float>::makeFirstOrderLowPass (sampleRate, bands [index].frequency);
-                break;
-            case LowShelf:
-                newCoefficients = juce::dsp::IIR::Coefficients<float>::makeLowShelf (sampleRate, bands [index].frequency, bands [index].quality, bands [index].gain);
-                break;
-            case BandPass:
-                newCoefficients = juce::dsp::IIR::Coefficients<float>::makeBandPass (sampleRate, bands [index].frequency, bands [index].quality);
-                break;
-            case AllPass:
-                newCoefficients = juce::dsp::IIR::Coefficients<float>::makeAllPass (sampleRate, bands [index].frequency, bands [index].quality);
-                break;
-            case AllPass1st:
-                newCoefficients = juce::dsp::IIR::Coefficients<float>::makeFirstOrderAllPass (sampleRate, bands [index].frequency);
-                break;
-            case Notch:
-                newCoefficients = juce::dsp::IIR::Coefficients<float>::makeNotch (sampleRate, bands [index].frequency, bands [index].quality);
-                break;
-            case Peak:
-                newCoefficients = juce::dsp::IIR::Coefficients<float>::makePeakFilter (sampleRate, bands [index].frequency, bands [index].quality, bands [index].gain);
-                break;
-            case HighShelf:
-                newCoefficients = juce::dsp::IIR::Coefficients<float>::makeHighShelf (sampleRate, bands [index].frequency, bands [index].quality, bands [index].gain);
-                break;
-            case HighPass1st:
-                newCoefficients = juce::dsp::IIR::Coefficients<float>::makeFirstOrderHighPass (sampleRate, bands [index].frequency);
-                break;
-            case HighPass:
-                newCoefficients = juce::dsp::IIR::Coefficients<float>::makeHighPass (sampleRate, bands [index].frequency, bands [index].quality);
-                break;
-            case LastFilterID:
-            default:
-                break;
-        }
+        const auto band = getBand (index);
+        const auto newCoefficients = coefficientCache.get (int (band.type), sampleRate, band.frequency, band.quality, band.gain);
 
-        if (newCoefficients)
+        // while snapshots play, the change waits for releaseSnapshots()
+        if (! snapshots.updateLive (getSnapshotSettings()))
         {
-            {
-                // minimise lock scope, get<0>() needs to be a  compile time constant
-                juce::ScopedLock processLock (getCallbackLock());
-                if (index == 0)
-                    *filter.get<0>().state = *newCoefficients;
-                else if (index == 1)
-                    *filter.get<1>().state = *newCoefficients;
-                else if (index == 2)
-                    *filter.get<2>().state = *newCoefficients;
-                else if (index == 3)
-                    *filter.get<3>().state = *newCoefficients;
-                else if (index == 4)
-                    *filter.get<4>().state = *newCoefficients;
-                else if (index == 5)
-                    *filter.get<5>().state = *newCoefficients;
-            }
-            newCoefficients->getMagnitudeForFrequencyArray (frequencies.data(),
-                                                            bands [index].magnitudes.data(),
-                                                            frequencies.size(), sampleRate);
+            designedCoefficients.modify ([&] (DesignedCoefficients& designed) { designed [index] = newCoefficients; });
+            pendingBands.fetch_or (1u << index, std::memory_order_release);
+        }
+        responses.invalidateBand (int (index));
+
+        updatePlots();
+    }
+}
+
+void FrequalizerAudioProcessor::updateAllBands()
+{
+    FREQUALIZER_TRACE_SCOPE ("updateAllBands")
+    if (sampleRate > 0) {
+        const auto current = bands.load();
+        std::array<Snapshots::Biquad, numBands> newCoefficients;
+        for (size_t i = 0; i < numBands; ++i)
+            newCoefficients [i] = coefficientCache.get (int (current [i].type), sampleRate, current [i].frequency,
+                                                        current [i].quality, current [i].gain);
 
+        if (! snapshots.updateLive (getSnapshotSettings()))
+        {
+            designedCoefficients.store (newCoefficients);
+            pendingBands.fetch_or ((1u << numBands) - 1, std::memory_order_release);
         }
-        updateBypassedStates();
+
+        for (size_t i = 0; i < numBands; ++i)
+            responses.invalidateBand (int (i));
+
         updatePlots();
     }
 }
 
+void FrequalizerAudioProcessor::applyPendingCoefficients()
+{
+    const auto changed = pendingBands.exchange (0, std::memory_order_acquire);
+    if (changed == 0)
+        return;
+
+    const auto designed = designedCoefficients.load();
+    for (size_t i = 0; i < numBands; ++i)
+        if (changed & (1u << i))
+            setFilterCoefficients (i, designed [i]);
+}
+
+void FrequalizerAudioProcessor::setFilterCoefficients (size_t index, const Snapshots::Biquad& coefficients)
+{
+    // keeps the storage, it was allocated in prepareToPlay
+    auto& values = getFilterState (index).coefficients;
+    values.clearQuick();
+    values.addArray (coefficients.data(), int (coefficients.size()));
+}
+
+const juce::dsp::IIR::Coefficients<float>& FrequalizerAudioProcessor::getBandCoefficients (size_t index) const
+{
+    return const_cast<FrequalizerAudioProcessor*> (this)->getFilterState (index);
+}
+
+juce::dsp::IIR::Coefficients<float>& FrequalizerAudioProcessor::getFilterState (size_t index)
+{
+    // get<0>() needs to be a compile time constant
+    switch (index)
+    {
+        case 0:  return *filter.get<0>().state;
+        case 1:  return *filter.get<1>().state;
+        case 2:  return *filter.get<2>().state;
+        case 3:  return *filter.get<3>().state;
+        case 4:  return *filter.get<4>().state;
+        case 5:
+        default: return *filter.get<5>().state;
+    }
+}
+
+void FrequalizerAudioProcessor::setBandBypassed (size_t index, bool shouldBeBypassed)
+{
+    switch (index)
+    {
+        case 0: filter.setBypassed<0> (shouldBeBypassed); break;
+        case 1: filter.setBypassed<1> (shouldBeBypassed); break;
+        case 2: filter.setBypassed<2> (shouldBeBypassed); break;
+        case 3: filter.setBypassed<3> (shouldBeBypassed); break;
+        case 4: filter.setBypassed<4> (shouldBeBypassed); break;
+        case 5: filter.setBypassed<5> (shouldBeBypassed); break;
+        default: break;
+    }
+}
+
 void FrequalizerAudioProcessor::updatePlots ()
 {
-    auto gain = filter.get<6>().getGainLinear();
-    std::fill (magnitudes.begin(), magnitudes.end(), gain);
+    juce::uint32 activeBands = 0;
 
-    if (juce::isPositiveAndBelow (soloed, bands.size())) {
-        juce::FloatVectorOperations::multiply (magnitudes.data(), bands [size_t (soloed)].magnitudes.data(), static_cast<int> (magnitudes.size()));
+    const auto solo = soloed.load();
+    if (juce::isPositiveAndBelow (solo, numBands)) {
+        activeBands = 1u << solo;
     }
     else
     {
-        for (size_t i=0; i < bands.size(); ++i)
-            if (bands[i].active)
-                juce::FloatVectorOperations::multiply (magnitudes.data(), bands [i].magnitudes.data(), static_cast<int> (magnitudes.size()));
+        const auto current = bands.load();
+        for (size_t i=0; i < numBands; ++i)
+            if (current[i].active)
+                activeBands |= 1u << i;
     }
 
-    sendChangeMessage();
+    // the editor picks the change up at its next frame, without an editor nothing is computed
+    responses.setOverall (outputGain->load(), activeBands);
 }
 
 //==============================================================================
@@ -542,61 +723,333 @@ juce::AudioProcessorEditor* FrequalizerAudioProcessor::createEditor()
     return new FrequalizerAudioProcessorEditor (*this);
 }
 
-const std::vector<double>& FrequalizerAudioProcessor::getMagnitudes ()
+void FrequalizerAudioProcessor::setResponseResolution (int numPoints)
+{
+    responses.setNumPoints (numPoints);
+}
+
+void FrequalizerAudioProcessor::getFrequencyResponse (int index, std::vector<float>& log2Magnitudes) const
+{
+    responses.getResponse (index, log2Magnitudes);
+}
+
+juce::uint32 FrequalizerAudioProcessor::fetchChangedBands()
 {
-    return magnitudes;
+    return responses.fetchChangedBands();
 }
 
-void FrequalizerAudioProcessor::createFrequencyPlot (juce::Path& p, const std::vector<double>& mags, const juce::Rectangle<int> bounds, float pixelsPerDouble)
+void FrequalizerAudioProcessor::createFrequencyPlot (juce::Path& p, const std::vector<float>& log2Mags, const juce::Rectangle<int> bounds, float pixelsPerDouble)
 {
-    p.startNewSubPath (float (bounds.getX()), mags [0] > 0 ? float (bounds.getCentreY() - pixelsPerDouble * std::log (mags [0]) / std::log (2.0)) : bounds.getBottom());
-    const auto xFactor = static_cast<double> (bounds.getWidth()) / frequencies.size();
-    for (size_t i=1; i < frequencies.size(); ++i)
+    if (log2Mags.empty())
+        return;
+
+    // just outside the bounds, so deep notches don't reach far below the plot
+    const auto toY = [&] (float log2Mag)
     {
-        p.lineTo (float (bounds.getX() + i * xFactor),
-                  float (mags [i] > 0 ? bounds.getCentreY() - pixelsPerDouble * std::log (mags [i]) / std::log (2.0) : bounds.getBottom()));
-    }
+        return juce::jlimit (float (bounds.getY() - 1), float (bounds.getBottom() + 1),
+                             float (bounds.getCentreY()) - pixelsPerDouble * log2Mag);
+    };
+
+    p.preallocateSpace (int (3 * log2Mags.size()));
+    p.startNewSubPath (float (bounds.getX()), toY (log2Mags [0]));
+    const auto xFactor = static_cast<double> (bounds.getWidth()) / log2Mags.size();
+    for (size_t i=1; i < log2Mags.size(); ++i)
+        p.lineTo (float (bounds.getX() + i * xFactor), toY (log2Mags [i]));
 }
 
-void FrequalizerAudioProcessor::createAnalyserPlot (juce::Path& p, const juce::Rectangle<int> bounds, float minFreq, bool input)
+void FrequalizerAudioProcessor::createAnalyserPlot (juce::Path& p, const juce::Rectangle<int> bounds, float minFreq, bool input, int view)
 {
-    if (input)
-        inputAnalyser.createPath (p, bounds.toFloat(), minFreq);
-    else
-        outputAnalyser.createPath (p, bounds.toFloat(), minFreq);
+    analyser.createPath (p, bounds.toFloat(), minFreq, input ? AnalyserInput : AnalyserOutput, view);
+}
+
+bool FrequalizerAudioProcessor::getAnalyserPixelLevels (BinToPixelMap& map, std::vector<float>& levels, int numPixels, float minFreq, bool input, int view)
+{
+    return analyser.getPixelLevels (map, levels, numPixels, minFreq, input ? AnalyserInput : AnalyserOutput, view);
+}
+
+bool FrequalizerAudioProcessor::getAnalyserFrameLevels (BinToPixelMap& map, std::vector<float>& levels, int numPixels, float minFreq, bool input, juce::int64 frame)
+{
+    return analyser.getFramePixelLevels (map, levels, numPixels, minFreq, input ? AnalyserInput : AnalyserOutput, frame);
+}
+
+float FrequalizerAudioProcessor::getAnalyserBins (std::vector<float>& bins, bool input, int view)
+{
+    return analyser.copyAverage (bins, input ? AnalyserInput : AnalyserOutput, view);
 }
 
 bool FrequalizerAudioProcessor::checkForNewAnalyserData()
 {
-    return inputAnalyser.checkForNewData() || outputAnalyser.checkForNewData();
+    return analyser.checkForNewData();
+}
+
+Analyser<float>::Diagnostics FrequalizerAudioProcessor::getAnalyserDiagnostics() const
+{
+    return analyser.getDiagnostics();
+}
+
+int FrequalizerAudioProcessor::getNumAnalyserViews() const
+{
+    return analyser.getNumViews();
+}
+
+juce::String FrequalizerAudioProcessor::getAnalyserViewName (int view) const
+{
+    switch (view)
+    {
+        case Analyser<float>::SumView:  return TRANS ("Sum");
+        case Analyser<float>::MidView:  return TRANS ("Mid");
+        case Analyser<float>::SideView: return TRANS ("Side");
+        default: break;
+    }
+
+    const auto channel = view - Analyser<float>::FirstChannelView;
+    if (auto* bus = getBus (true, 0))
+        return juce::AudioChannelSet::getChannelTypeName (bus->getCurrentLayout().getTypeOfChannel (channel));
+
+    return TRANS ("Channel") + " " + juce::String (channel + 1);
+}
+
+bool FrequalizerAudioProcessor::isAnalyserViewVisible (int view) const
+{
+    return analyser.isViewVisible (view);
+}
+
+void FrequalizerAudioProcessor::setAnalyserVisibleViews (juce::uint32 mask)
+{
+    analyser.setVisibleViews (mask);
+}
+
+juce::uint32 FrequalizerAudioProcessor::getAnalyserVisibleViews() const
+{
+    return analyser.getVisibleViews();
+}
+
+void FrequalizerAudioProcessor::setAnalyserAveragingMode (Analyser<float>::AveragingMode mode)
+{
+    analyser.setAveragingMode (mode);
+}
+
+Analyser<float>::AveragingMode FrequalizerAudioProcessor::getAnalyserAveragingMode() const
+{
+    return analyser.getAveragingMode();
+}
+
+void FrequalizerAudioProcessor::setAnalyserAveragingTime (float seconds)
+{
+    analyser.setAveragingTime (seconds);
+}
+
+float FrequalizerAudioProcessor::getAnalyserAveragingTime() const
+{
+    return analyser.getAveragingTime();
+}
+
+void FrequalizerAudioProcessor::resetAnalyserAveraging()
+{
+    analyser.resetAveraging();
+}
+
+LoadMeter& FrequalizerAudioProcessor::getLoadMeter()
+{
+    return loadMeter;
+}
+
+bool FrequalizerAudioProcessor::startAutomationCapture (const juce::File& file)
+{
+    return capture.start (file, *this);
+}
+
+void FrequalizerAudioProcessor::stopAutomationCapture()
+{
+    capture.stop();
+}
+
+bool FrequalizerAudioProcessor::isCapturingAutomation() const
+{
+    return capture.isCapturing();
+}
+
+void FrequalizerAudioProcessor::setUndoLimit (int maxUnits)
+{
+    undoBudget->setInstanceLimit (undo, maxUnits);
+}
+
+int FrequalizerAudioProcessor::getUndoMemoryUse() const
+{
+    return undo.getNumberOfUnitsTakenUpByStoredCommands();
+}
+
+juce::int64 FrequalizerAudioProcessor::getTotalUndoMemoryUse() const
+{
+    return undoBudget->getTotalUnitsInUse();
+}
+
+CoefficientCache::Statistics FrequalizerAudioProcessor::getCoefficientCacheStatistics() const
+{
+    return coefficientCache.getStatistics();
+}
+
+CoefficientCache::Statistics FrequalizerAudioProcessor::getResponseCacheStatistics() const
+{
+    return { responses.getNumCacheHits(), responses.getNumCacheMisses() };
+}
+
+//==============================================================================
+Snapshots::Settings FrequalizerAudioProcessor::getSnapshotSettings() const
+{
+    Snapshots::Settings settings;
+    const auto current = bands.load();
+    for (size_t i = 0; i < std::min (size_t (numBands), size_t (Snapshots::numBands)); ++i)
+    {
+        const auto& band = current [i];
+        settings.bands [i] = { int (band.type), band.frequency, band.quality, band.gain, band.active };
+    }
+
+    settings.outputGain = outputGain->load();
+    return settings;
+}
+
+void FrequalizerAudioProcessor::storeSnapshot (int slot)
+{
+    snapshots.store (slot, getSnapshotSettings());
+}
+
+bool FrequalizerAudioProcessor::hasSnapshot (int slot) const
+{
+    return snapshots.isStored (slot);
+}
+
+void FrequalizerAudioProcessor::recallSnapshot (int slot)
+{
+    morphSnapshots (slot, slot, 0.0f);
+}
+
+void FrequalizerAudioProcessor::morphSnapshots (int slotA, int slotB, float amount)
+{
+    if (! hasSnapshot (slotA) || ! hasSnapshot (slotB))
+        return;
+
+    snapshots.engage (getSnapshotSettings());
+    snapshots.select (slotA, slotB, amount);
+}
+
+void FrequalizerAudioProcessor::releaseSnapshots()
+{
+    snapshots.release (getSnapshotSettings());
+}
+
+bool FrequalizerAudioProcessor::isPlayingSnapshots() const
+{
+    return snapshots.isEngaged();
+}
+
+void FrequalizerAudioProcessor::setSnapshotGlideTime (float seconds)
+{
+    snapshots.setGlideTime (seconds);
+}
+
+void FrequalizerAudioProcessor::processSnapshots (juce::dsp::AudioBlock<float>& block)
+{
+    const auto numSamples = block.getNumSamples();
+
+    for (size_t start = 0; start < numSamples; start += size_t (Snapshots::controlInterval))
+    {
+        auto step = block.getSubBlock (start, std::min (numSamples - start, size_t (Snapshots::controlInterval)));
+
+        if (auto* frame = snapshots.advance (int (step.getNumSamples())))
+        {
+            for (size_t i = 0; i < Snapshots::numBands; ++i)
+                if (frame->changedBands & (1u << i))
+                    setFilterCoefficients (i, frame->coefficients [i]);
+
+            updateBypassedStates (frame->activeBands);
+            filter.get<6>().setGainLinear (frame->outputGain);
+        }
+
+        juce::dsp::ProcessContextReplacing<float> context (step);
+        filter.process (context);
+    }
 }
 
 //==============================================================================
+juce::StringArray FrequalizerAudioProcessor::getStateParameterIDs() const
+{
+    juce::StringArray paramIDs { paramOutput };
+    for (size_t i = 0; i < numBands; ++i)
+        paramIDs.addArray ({ getTypeParamName (i), getFrequencyParamName (i), getQualityParamName (i),
+                             getGainParamName (i), getActiveParamName (i) });
+    return paramIDs;
+}
+
 void FrequalizerAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    auto editor = state.state.getOrCreateChildWithName (IDs::editor, nullptr);
-    editor.setProperty (IDs::sizeX, editorSize.x, nullptr);
-    editor.setProperty (IDs::sizeY, editorSize.y, nullptr);
+    const auto paramIDs = getStateParameterIDs();
+
+    juce::MemoryOutputStream stream (destData, false);
+    stream.writeInt (stateMagic);
+    stream.writeInt (stateVersion);
+    stream.writeShort (juce::int16 (editorSize.x));
+    stream.writeShort (juce::int16 (editorSize.y));
+    stream.writeShort (juce::int16 (paramIDs.size()));
 
-    juce::MemoryOutputStream stream(destData, false);
-    state.state.writeToStream (stream);
+    for (const auto& paramID : paramIDs)
+        stream.writeFloat (state.getRawParameterValue (paramID)->load());
 }
 
 void FrequalizerAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    auto tree = juce::ValueTree::readFromData (data, size_t (sizeInBytes));
-    if (tree.isValid()) {
+    FREQUALIZER_TRACE_SCOPE ("setStateInformation")
+
+    juce::MemoryInputStream stream (data, size_t (sizeInBytes), false);
+
+    if (sizeInBytes >= 8 && stream.readInt() == stateMagic)
+    {
+        if (stream.readInt() > stateVersion)
+            return;
+
+        editorSize.setX (stream.readShort());
+        editorSize.setY (stream.readShort());
+
+        const auto paramIDs = getStateParameterIDs();
+        const auto numValues = std::min (int (stream.readShort()), paramIDs.size());
+
+        restoringState = true;
+        for (int i = 0; i < numValues && ! stream.isExhausted(); ++i)
+        {
+            const auto value = stream.readFloat();
+            if (auto* parameter = state.getParameter (paramIDs [i]))
+            {
+                // the host reads the restored values itself, the listeners update the bands
+                const auto normalised = parameter->convertTo0to1 (value);
+                parameter->setValue (normalised);
+                parameter->sendValueChangedMessageToListeners (normalised);
+            }
+        }
+        restoringState = false;
+    }
+    else
+    {
+        // states saved before version 1.1 are the whole ValueTree
+        auto tree = juce::ValueTree::readFromData (data, size_t (sizeInBytes));
+        if (! tree.isValid())
+            return;
+
+        restoringState = true;
         state.state = tree;
+        restoringState = false;
 
         auto editor = state.state.getChildWithName (IDs::editor);
         if (editor.isValid())
         {
             editorSize.setX (editor.getProperty (IDs::sizeX, 900));
             editorSize.setY (editor.getProperty (IDs::sizeY, 500));
-            if (auto* thisEditor = getActiveEditor())
-                thisEditor->setSize (editorSize.x, editorSize.y);
         }
     }
+
+    updateAllBands();
+
+    if (auto* thisEditor = getActiveEditor())
+        thisEditor->setSize (editorSize.x, editorSize.y);
 }
 
 juce::Point<int> FrequalizerAudioProcessor::getSavedSize() const
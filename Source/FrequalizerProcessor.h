@@ -16,7 +16,7 @@
 */
 class FrequalizerAudioProcessor  : public juce::AudioProcessor,
                                    public juce::AudioProcessorValueTreeState::Listener,
-                                   public juce::ChangeBroadcaster
+                                   public juce::AudioProcessorParameter::Listener
 {
 public:
     enum FilterType
@@ -57,6 +57,7 @@ public:
     //==============================================================================
     void prepareToPlay (double newSampleRate, int newSamplesPerBlock) override;
     void releaseResources() override;
+    void reset() override;
 
    #ifndef JucePlugin_PreferredChannelConfigurations
     bool isBusesLayoutSupported (const BusesLayout& layouts) const override;
@@ -66,6 +67,9 @@ public:
 
     void parameterChanged (const juce::String& parameter, float newValue) override;
 
+    void parameterValueChanged (int parameterIndex, float newValue) override;
+    void parameterGestureChanged (int parameterIndex, bool gestureIsStarting) override;
+
     juce::AudioProcessorValueTreeState& getPluginState();
 
     size_t getNumBands () const;
@@ -78,18 +82,104 @@ public:
 
     static juce::StringArray getFilterTypeNames();
 
+    /** Designs the filter of a band as biquad without allocating, so the audio thread can use it.
+        This is the only design of the filters, the plot and the tools use it as well. */
+    static Snapshots::Biquad makeBiquad (FilterType type, double rate, float frequency, float quality, float gain);
+
+    /** The CoefficientCache::Uses flags of the parameters a filter type depends on */
+    static int getFilterUses (FilterType type);
+
+    /** The coefficients the filter of a band currently runs. Changes reach the filter with the
+        next processBlock(), so call it from the audio thread or while no block is processed. */
+    const juce::dsp::IIR::Coefficients<float>& getBandCoefficients (size_t index) const;
+
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
     bool hasEditor() const override;
 
-    const std::vector<double>& getMagnitudes ();
+    /** Sets the number of points of the frequency responses, usually the width of the plot */
+    void setResponseResolution (int numPoints);
+
+    /** Copies the log2 magnitudes of a band, or of the overall response for index -1 */
+    void getFrequencyResponse (int index, std::vector<float>& log2Magnitudes) const;
+
+    /** Polled by the editor at frame rate. Returns a bit per band, that changed since the last
+        call, so the editor only needs to recompute the curves of those bands, and
+        ResponseCurves::overallChanged if anything changed at all. */
+    juce::uint32 fetchChangedBands();
+
+    void createFrequencyPlot (juce::Path& p, const std::vector<float>& log2Mags, const juce::Rectangle<int> bounds, float pixelsPerDouble);
 
-    void createFrequencyPlot (juce::Path& p, const std::vector<double>& mags, const juce::Rectangle<int> bounds, float pixelsPerDouble);
+    void createAnalyserPlot (juce::Path& p, const juce::Rectangle<int> bounds, float minFreq, bool input, int view = 0);
 
-    void createAnalyserPlot (juce::Path& p, const juce::Rectangle<int> bounds, float minFreq, bool input);
+    bool getAnalyserPixelLevels (BinToPixelMap& map, std::vector<float>& levels, int numPixels, float minFreq, bool input, int view = 0);
+
+    bool getAnalyserFrameLevels (BinToPixelMap& map, std::vector<float>& levels, int numPixels, float minFreq, bool input, juce::int64 frame);
+
+    float getAnalyserBins (std::vector<float>& bins, bool input, int view = 0);
 
     bool checkForNewAnalyserData();
 
+    Analyser<float>::Diagnostics getAnalyserDiagnostics() const;
+
+    int getNumAnalyserViews() const;
+    juce::String getAnalyserViewName (int view) const;
+    bool isAnalyserViewVisible (int view) const;
+    void setAnalyserVisibleViews (juce::uint32 mask);
+    juce::uint32 getAnalyserVisibleViews() const;
+
+    void setAnalyserAveragingMode (Analyser<float>::AveragingMode mode);
+    Analyser<float>::AveragingMode getAnalyserAveragingMode() const;
+
+    void setAnalyserAveragingTime (float seconds);
+    float getAnalyserAveragingTime() const;
+
+    void resetAnalyserAveraging();
+
+    /** Measures the time spent in processBlock while it is enabled */
+    LoadMeter& getLoadMeter();
+
+    /** Records parameter changes and input audio of each block to a file, to replay them
+        with frequalizer_replay. Returns false if the file can't be written. */
+    bool startAutomationCapture (const juce::File& file);
+    void stopAutomationCapture();
+    bool isCapturingAutomation() const;
+
+    //==============================================================================
+    static constexpr int numSnapshots = Snapshots::numSlots;
+
+    /** Stores the current settings together with their coefficients */
+    void storeSnapshot (int slot);
+    bool hasSnapshot (int slot) const;
+
+    /** Plays a snapshot instead of the parameters. Once playing, switching only sets
+        atomics and the audio thread glides to the new settings. */
+    void recallSnapshot (int slot);
+
+    /** Plays a mix of two snapshots, amount 0 is slotA and 1 is slotB. Frequency, quality and
+        gain are interpolated, a band with a different type or on/off state in the two snapshots
+        switches at an amount of 0.5, it is not crossfaded. */
+    void morphSnapshots (int slotA, int slotB, float amount);
+
+    /** Glides back to the parameters */
+    void releaseSnapshots();
+    bool isPlayingSnapshots() const;
+
+    void setSnapshotGlideTime (float seconds);
+
+    //==============================================================================
+    /** Limits the undo history of this instance, in addition to the budget all instances share */
+    void setUndoLimit (int maxUnits);
+
+    /** Units kept by the undo history, roughly bytes, of this instance and of all instances */
+    int getUndoMemoryUse() const;
+    juce::int64 getTotalUndoMemoryUse() const;
+
+    //==============================================================================
+    /** Hits and misses of the cached filter designs, and of the cached response curves */
+    CoefficientCache::Statistics getCoefficientCacheStatistics() const;
+    CoefficientCache::Statistics getResponseCacheStatistics() const;
+
     //==============================================================================
     const juce::String getName() const override;
 
@@ -112,29 +202,31 @@ public:
     void setSavedSize (const juce::Point<int>& size);
 
     //==============================================================================
-    struct Band {
-        Band (const juce::String& nameToUse, juce::Colour colourToUse, FilterType typeToUse,
-            float frequencyToUse, float qualityToUse, float gainToUse=1.0f, bool shouldBeActive=true)
-          : name (nameToUse),
-            colour (colourToUse),
-            type (typeToUse),
-            frequency (frequencyToUse),
-            quality (qualityToUse),
-            gain (gainToUse),
-            active (shouldBeActive)
-        {}
+    /** The settings of a band, that the filters are designed from. All bands are published
+        together through a SeqLock, so every thread reads a consistent set without locking. */
+    struct Band
+    {
+        FilterType type      = BandPass;
+        float      frequency = 1000.0f;
+        float      quality   = 1.0f;
+        float      gain      = 1.0f;
+        bool       active    = true;
+    };
 
+    /** What only the editor needs, it doesn't change after construction */
+    struct BandInfo
+    {
         juce::String name;
         juce::Colour colour;
-        FilterType   type      = BandPass;
-        float        frequency = 1000.0f;
-        float        quality   = 1.0f;
-        float        gain      = 1.0f;
-        bool         active    = true;
-        std::vector<double> magnitudes;
     };
 
-    Band* getBand (size_t index);
+    // needs to be in sync with the ProcessorChain filter
+    static constexpr size_t numBands = 6;
+    using BandParameters = std::array<Band, numBands>;
+
+    /** Returns a copy of the current settings, or a default band for an invalid index */
+    Band getBand (size_t index) const;
+    BandParameters getBands() const;
     int getBandIndexFromID (juce::String paramID);
 
 private:
@@ -143,30 +235,83 @@ private:
 
     void updateBand (const size_t index);
 
-    void updateBypassedStates ();
+    /** Rebuilds the coefficients of all bands at once, e.g. after restoring a state */
+    void updateAllBands();
+
+    /** Applies the coefficients updateBand() designed since the last block, on the audio thread only */
+    void applyPendingCoefficients();
+
+    /** On the audio thread only. All bands are stored as biquads, so the filter order
+        never changes and switching snapshots on the audio thread doesn't allocate. */
+    void setFilterCoefficients (size_t index, const Snapshots::Biquad& coefficients);
+    juce::dsp::IIR::Coefficients<float>& getFilterState (size_t index);
+    void setBandBypassed (size_t index, bool shouldBeBypassed);
+
+    void processSnapshots (juce::dsp::AudioBlock<float>& block);
+
+    Snapshots::Settings getSnapshotSettings() const;
+
+    /** The parameters in the order of the binary state */
+    juce::StringArray getStateParameterIDs() const;
+
+    /** Bypasses the filter bands from the solo and the active bands, on the audio thread only */
+    void updateBypassedStates (juce::uint32 activeBands);
 
     void updatePlots ();
 
+    juce::SharedResourcePointer<UndoBudget> undoBudget;
     juce::UndoManager                  undo;
     juce::AudioProcessorValueTreeState state;
 
-    std::vector<Band>    bands;
+    const std::vector<BandInfo> bandInfos;
+    SeqLock<BandParameters>     bands;
 
-    std::vector<double> frequencies;
-    std::vector<double> magnitudes;
+    ResponseCurves       responses { int (numBands) };
 
     bool wasBypassed = true;
 
+    static constexpr int stateMagic   = 0x54535146;     // "FQST"
+    static constexpr int stateVersion = 1;
+
+    /** Set while a state is restored, so the parameters don't rebuild their band each */
+    std::atomic<bool> restoringState { false };
+
     using FilterBand = juce::dsp::ProcessorDuplicator<juce::dsp::IIR::Filter<float>, juce::dsp::IIR::Coefficients<float>>;
     using Gain       = juce::dsp::Gain<float>;
     juce::dsp::ProcessorChain<FilterBand, FilterBand, FilterBand, FilterBand, FilterBand, FilterBand, Gain> filter;
 
     double sampleRate = 0;
 
-    int soloed = -1;
+    /** Designed on the thread that changed a parameter, the bits in pendingBands mark the
+        bands the audio thread still has to copy into the filter, so automation takes no lock */
+    using DesignedCoefficients = std::array<Snapshots::Biquad, numBands>;
+    SeqLock<DesignedCoefficients> designedCoefficients;
+    std::atomic<juce::uint32>     pendingBands { 0 };
+
+    std::atomic<int> soloed { -1 };
+
+    /** The raw output parameter, the gain stage itself is only set on the audio thread */
+    std::atomic<float>* outputGain = nullptr;
+
+    enum AnalyserSignal
+    {
+        AnalyserInput = 0,
+        AnalyserOutput,
+        NumAnalyserSignals
+    };
+
+    Analyser<float> analyser { NumAnalyserSignals };
+
+    LoadMeter       loadMeter;
+
+    AutomationCapture capture;
+
+    Snapshots       snapshots { [] (int type, double rate, float frequency, float quality, float gain)
+                                { return makeBiquad (FilterType (type), rate, frequency, quality, gain); } };
 
-    Analyser<float> inputAnalyser;
-    Analyser<float> outputAnalyser;
+    CoefficientCache coefficientCache { [] (int type, double rate, float frequency, float quality, float gain)
+                                        { return makeBiquad (FilterType (type), rate, frequency, quality, gain); },
+                                        [] (int type) { return getFilterUses (FilterType (type)); } };
 
     juce::Point<int> editorSize = { 900, 500 };
 };
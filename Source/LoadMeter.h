@@ -0,0 +1,266 @@
+/*
+  ==============================================================================
+
+    This measures the DSP load of one Frequalizer instance
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+//==============================================================================
+/**
+    Measures the time spent in processBlock, split into sections. The audio thread
+    is the only writer, so the histograms are plain atomic counters written with
+    relaxed stores, and any thread can read them at any time. While the meter is
+    disabled a block costs a single atomic load.
+
+    Both histograms have four bins per octave of nanoseconds, one is fed with the
+    time per block, the other with the time per sample.
+*/
+class LoadMeter
+{
+public:
+    enum Section
+    {
+        Filter = 0,
+        AnalyserFeed,
+        Total,
+        NumSections
+    };
+
+    enum Metric
+    {
+        PerBlock = 0,
+        PerSample,
+        NumMetrics
+    };
+
+    static constexpr int numBins       = 96;
+    static constexpr int binsPerOctave = 4;
+
+    LoadMeter() = default;
+
+    void setEnabled (bool shouldBeEnabled)
+    {
+        enabled.store (shouldBeEnabled);
+    }
+
+    bool isEnabled() const
+    {
+        return enabled.load (std::memory_order_relaxed);
+    }
+
+    void prepare (double sampleRateToUse)
+    {
+        sampleRate   = sampleRateToUse;
+        nanosPerTick = 1.0e9 / double (juce::Time::getHighResolutionTicksPerSecond());
+        reset();
+    }
+
+    /** Clears all statistics. The audio thread does it before its next block. */
+    void reset()
+    {
+        resetRequested.store (true);
+    }
+
+    static const char* getSectionName (Section section)
+    {
+        switch (section)
+        {
+            case Filter:       return "Filter";
+            case AnalyserFeed: return "Analyser";
+            case Total:        return "Total";
+            case NumSections:
+            default:           return "";
+        }
+    }
+
+    /** Returns the lower bound of a histogram bin in nanoseconds */
+    static double getBinStart (int bin)
+    {
+        return std::pow (2.0, double (bin) / binsPerOctave);
+    }
+
+    //==============================================================================
+    struct Snapshot
+    {
+        std::array<std::array<std::array<juce::uint32, numBins>, NumMetrics>, NumSections> histograms {};
+        std::array<double, NumSections> averageNanosPerBlock {};
+        std::array<double, NumSections> maxNanosPerBlock {};
+        juce::int64 numBlocks   = 0;
+        float       averageLoad = 0.0f;  // time spent in processBlock relative to the duration of the block
+        float       peakLoad    = 0.0f;
+
+        /** Returns the upper bound in nanoseconds, that a fraction of the measurements stayed below */
+        double getPercentile (Section section, Metric metric, double fraction) const
+        {
+            const auto& bins = histograms [size_t (section)][size_t (metric)];
+            juce::int64 total = 0;
+            for (auto count : bins)
+                total += count;
+
+            juce::int64 sum = 0;
+            for (int bin = 0; bin < numBins; ++bin)
+            {
+                sum += bins [size_t (bin)];
+                if (total > 0 && double (sum) >= fraction * double (total))
+                    return getBinStart (bin + 1);
+            }
+            return 0.0;
+        }
+    };
+
+    Snapshot getSnapshot() const
+    {
+        Snapshot snapshot;
+        for (size_t section = 0; section < NumSections; ++section)
+        {
+            for (size_t metric = 0; metric < NumMetrics; ++metric)
+                for (size_t bin = 0; bin < numBins; ++bin)
+                    snapshot.histograms [section][metric][bin] = histograms [section][metric][bin].load (std::memory_order_relaxed);
+
+            const auto blocks = numBlocks.load (std::memory_order_relaxed);
+            snapshot.averageNanosPerBlock [section] = blocks > 0 ? double (sumNanos [section].load (std::memory_order_relaxed)) / double (blocks) : 0.0;
+            snapshot.maxNanosPerBlock [section]     = double (maxNanos [section].load (std::memory_order_relaxed));
+        }
+
+        snapshot.numBlocks   = numBlocks.load (std::memory_order_relaxed);
+        snapshot.averageLoad = averageLoad.load (std::memory_order_relaxed);
+        snapshot.peakLoad    = peakLoad.load (std::memory_order_relaxed);
+        return snapshot;
+    }
+
+    //==============================================================================
+    /** Measures one processBlock call, the sections are added up inside */
+    class ScopedBlock
+    {
+    public:
+        ScopedBlock (LoadMeter& meterToUse, int numSamplesToUse)
+          : meter (meterToUse.isEnabled() ? &meterToUse : nullptr),
+            numSamples (numSamplesToUse)
+        {
+            if (meter != nullptr)
+                meter->beginBlock();
+        }
+
+        ~ScopedBlock()
+        {
+            if (meter != nullptr)
+                meter->endBlock (numSamples);
+        }
+
+    private:
+        LoadMeter* meter;
+        const int  numSamples;
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedBlock)
+    };
+
+    /** Adds the time of its lifetime to a section of the current block */
+    class ScopedSection
+    {
+    public:
+        ScopedSection (LoadMeter& meterToUse, Section sectionToUse)
+          : meter (meterToUse.measuring ? &meterToUse : nullptr),
+            section (sectionToUse),
+            start (meter != nullptr ? juce::Time::getHighResolutionTicks() : 0)
+        {
+        }
+
+        ~ScopedSection()
+        {
+            if (meter != nullptr)
+                meter->blockTicks [size_t (section)] += juce::Time::getHighResolutionTicks() - start;
+        }
+
+    private:
+        LoadMeter*  meter;
+        const Section section;
+        const juce::int64 start;
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedSection)
+    };
+
+private:
+    void beginBlock()
+    {
+        if (resetRequested.exchange (false))
+        {
+            for (auto& section : histograms)
+                for (auto& metric : section)
+                    for (auto& bin : metric)
+                        bin.store (0, std::memory_order_relaxed);
+
+            for (size_t section = 0; section < NumSections; ++section)
+            {
+                sumNanos [section].store (0, std::memory_order_relaxed);
+                maxNanos [section].store (0, std::memory_order_relaxed);
+            }
+
+            numBlocks.store (0, std::memory_order_relaxed);
+            averageLoad.store (0.0f, std::memory_order_relaxed);
+            peakLoad.store (0.0f, std::memory_order_relaxed);
+        }
+
+        blockTicks.fill (0);
+        blockStart = juce::Time::getHighResolutionTicks();
+        measuring  = true;
+    }
+
+    void endBlock (int numSamples)
+    {
+        measuring = false;
+        blockTicks [Total] = juce::Time::getHighResolutionTicks() - blockStart;
+
+        for (size_t section = 0; section < NumSections; ++section)
+        {
+            const auto nanos = double (blockTicks [section]) * nanosPerTick;
+            count (histograms [section][PerBlock], nanos);
+            count (histograms [section][PerSample], nanos / std::max (numSamples, 1));
+
+            const auto rounded = juce::int64 (nanos);
+            sumNanos [section].store (sumNanos [section].load (std::memory_order_relaxed) + rounded, std::memory_order_relaxed);
+            if (rounded > maxNanos [section].load (std::memory_order_relaxed))
+                maxNanos [section].store (rounded, std::memory_order_relaxed);
+        }
+
+        numBlocks.store (numBlocks.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        if (sampleRate > 0 && numSamples > 0)
+        {
+            const auto load = float (double (blockTicks [Total]) * nanosPerTick * sampleRate / (1.0e9 * numSamples));
+            const auto average = averageLoad.load (std::memory_order_relaxed);
+            averageLoad.store (average + 0.01f * (load - average), std::memory_order_relaxed);
+            if (load > peakLoad.load (std::memory_order_relaxed))
+                peakLoad.store (load, std::memory_order_relaxed);
+        }
+    }
+
+    static void count (std::array<std::atomic<juce::uint32>, numBins>& bins, double nanos)
+    {
+        const auto bin = juce::jlimit (0, numBins - 1, int (binsPerOctave * std::log2 (std::max (nanos, 1.0))));
+        bins [size_t (bin)].store (bins [size_t (bin)].load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    std::atomic<bool> enabled        { false };
+    std::atomic<bool> resetRequested { false };
+    double            sampleRate   = 0.0;
+    double            nanosPerTick = 1.0;
+
+    // only used on the audio thread
+    bool                                    measuring  = false;
+    juce::int64                             blockStart = 0;
+    std::array<juce::int64, NumSections>    blockTicks {};
+
+    std::array<std::array<std::array<std::atomic<juce::uint32>, numBins>, NumMetrics>, NumSections> histograms {};
+    std::array<std::atomic<juce::int64>, NumSections> sumNanos {};
+    std::array<std::atomic<juce::int64>, NumSections> maxNanos {};
+    std::atomic<juce::int64> numBlocks   { 0 };
+    std::atomic<float>       averageLoad { 0.0f };
+    std::atomic<float>       peakLoad    { 0.0f };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LoadMeter)
+};
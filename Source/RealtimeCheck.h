@@ -0,0 +1,67 @@
+/*
+  ==============================================================================
+
+    Marks the code, that needs to be real-time safe
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <utility>
+
+//==============================================================================
+/**
+    A Scope marks code running on the audio thread. When compiled with
+    FREQUALIZER_RT_CHECK the checking tool reports every allocation and every
+    mutex lock happening on a thread inside such a scope. Without the flag the
+    scope compiles to nothing.
+*/
+namespace RealtimeCheck
+{
+#if FREQUALIZER_RT_CHECK
+    inline int& getScopeDepth()
+    {
+        static thread_local int depth = 0;
+        return depth;
+    }
+
+    inline bool& getSuspended()
+    {
+        static thread_local bool suspended = false;
+        return suspended;
+    }
+
+    /** True if the current thread is inside a scope and the check is not suspended */
+    inline bool isChecking()
+    {
+        return getScopeDepth() > 0 && ! getSuspended();
+    }
+
+    struct Scope
+    {
+        Scope()  { ++getScopeDepth(); }
+        ~Scope() { --getScopeDepth(); }
+
+        Scope (const Scope&) = delete;
+        Scope& operator= (const Scope&) = delete;
+    };
+
+    /** Allows allocations and locks for a moment, e.g. to report a violation */
+    struct Suspend
+    {
+        Suspend()  : wasSuspended (std::exchange (getSuspended(), true)) {}
+        ~Suspend() { getSuspended() = wasSuspended; }
+
+        Suspend (const Suspend&) = delete;
+        Suspend& operator= (const Suspend&) = delete;
+
+        const bool wasSuspended;
+    };
+#else
+    struct Scope
+    {
+        Scope() {}
+    };
+#endif
+}
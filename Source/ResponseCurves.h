@@ -0,0 +1,347 @@
+/*
+  ==============================================================================
+
+    This computes the frequency responses displayed by the Frequalizer
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_dsp/juce_dsp.h>
+
+#include "Tracing.h"
+
+//==============================================================================
+/**
+    Evaluates the magnitude responses of the bands on a background thread. The
+    responses are sampled at one point per pixel on a logarithmic axis spanning
+    10 octaves from 20 Hz, and stored as log2 of the magnitude, so drawing needs
+    no logarithm per point and the overall response is simply the sum of the
+    active bands. When a band changes only that band is evaluated again and its
+    difference is added to the overall response. The last few evaluated curves are
+    kept by their coefficients, so a band returning to an earlier setting copies
+    its curve instead of evaluating it.
+
+    The setters only store atomics and set a flag. They take no lock and never
+    wake the thread, so they are safe on the audio thread. A changed band is only
+    marked, the thread designs its coefficients itself through designBand. The
+    editor polls fetchChangedBands() at frame rate, which starts the evaluation
+    of pending changes. Without an editor nothing is evaluated at all.
+*/
+class ResponseCurves : public juce::Thread
+{
+public:
+    /** Set in the result of fetchChangedBands(), when the overall response changed */
+    static constexpr juce::uint32 overallChanged = 1u << 31;
+
+    ResponseCurves (int numBandsToUse)
+      : juce::Thread ("Frequaliser-Responses"),
+        numBands (juce::jlimit (1, 16, numBandsToUse)),
+        current (size_t (numBands))
+    {
+        publishedBands.resize (size_t (numBands));
+        bands.resize (size_t (numBands));
+        resizeResponses (publishedBands, publishedOverall, pendingNumPoints.load());
+    }
+
+    ~ResponseCurves() override
+    {
+        stopThread (1000);
+    }
+
+    /** Sets the number of points, usually the width of the plot in pixels */
+    void setNumPoints (int numPointsToUse)
+    {
+        const auto newNumPoints = std::max (numPointsToUse, 2);
+        if (pendingNumPoints.exchange (newNumPoints) != newNumPoints)
+            pendingChanges.store (true);
+    }
+
+    void setSampleRate (double sampleRateToUse)
+    {
+        if (pendingSampleRate.exchange (sampleRateToUse) != sampleRateToUse)
+            pendingChanges.store (true);
+    }
+
+    /** Marks a band as changed, the thread designs it again with designBand */
+    void invalidateBand (int index)
+    {
+        if (! juce::isPositiveAndBelow (index, numBands))
+            return;
+
+        pendingBands.fetch_or (1u << index);
+        pendingChanges.store (true);
+    }
+
+    /** Sets the output gain and which bands contribute to the overall response */
+    void setOverall (float gain, juce::uint32 activeBands)
+    {
+        const auto gainChanged   = pendingGain.exchange (gain) != gain;
+        const auto activeChanged = pendingActive.exchange (activeBands) != activeBands;
+        if (gainChanged || activeChanged)
+            pendingChanges.store (true);
+    }
+
+    int getNumBands() const
+    {
+        return numBands;
+    }
+
+    /** Polled by the editor: starts evaluating pending changes and returns one bit for
+        each band, that was recomputed since the last call, plus overallChanged */
+    juce::uint32 fetchChangedBands()
+    {
+        if (pendingChanges.exchange (false))
+            triggerUpdate();
+
+        return changedBands.exchange (0);
+    }
+
+    /** How often a band curve was copied from the cache instead of evaluated */
+    juce::int64 getNumCacheHits() const     { return numCacheHits.load(); }
+    juce::int64 getNumCacheMisses() const   { return numCacheMisses.load(); }
+
+    /** Copies the log2 magnitudes of a band, or of the overall response for index -1 */
+    void getResponse (int index, std::vector<float>& log2Magnitudes) const
+    {
+        const juce::ScopedLock lock (publishLock);
+        if (index < 0)
+            log2Magnitudes = publishedOverall;
+        else if (index < numBands)
+            log2Magnitudes = publishedBands [size_t (index)];
+    }
+
+    /** Called on the thread with a band index and the sample rate, returns b0, b1, b2, a1, a2
+        normalised by a0. It needs to read the band settings without locking. */
+    std::function<std::array<float, 5> (int index, double sampleRate)> designBand;
+
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            updateResponses();
+            waitForUpdate.wait (-1);
+        }
+    }
+
+private:
+    struct Biquad
+    {
+        double b0 = 1.0, b1 = 0.0, b2 = 0.0, a1 = 0.0, a2 = 0.0;
+
+        bool operator== (const Biquad& other) const
+        {
+            return b0 == other.b0 && b1 == other.b1 && b2 == other.b2 && a1 == other.a1 && a2 == other.a2;
+        }
+    };
+
+    struct CachedResponse
+    {
+        Biquad             coefficients;
+        std::vector<float> log2Magnitudes;
+        bool               valid = false;
+    };
+
+    static constexpr size_t numCachedResponses = 16;
+
+    void triggerUpdate()
+    {
+        if (! isThreadRunning())
+            startThread (3);
+
+        waitForUpdate.signal();
+    }
+
+    void updateResponses()
+    {
+        FREQUALIZER_TRACE_SCOPE ("updateResponses")
+        const auto newNumPoints  = pendingNumPoints.load();
+        const auto newSampleRate = pendingSampleRate.load();
+        const auto newGain       = pendingGain.load();
+        const auto newActive     = pendingActive.load();
+        auto bandsToUpdate       = pendingBands.exchange (0u);
+
+        const auto allBands = (1u << numBands) - 1u;
+        auto resum = newGain != gain || newActive != active || ++numIncrementalUpdates > 64;
+
+        if (newNumPoints != numPoints || newSampleRate != sampleRate)
+        {
+            numPoints  = newNumPoints;
+            sampleRate = newSampleRate;
+            prepareGrid();
+            resizeResponses (bands, overall, numPoints);
+            bandsToUpdate = allBands;
+            resum = true;
+        }
+
+        gain   = newGain;
+        active = newActive;
+
+        if (bandsToUpdate == 0 && ! resum)
+            return;
+
+        for (int i = 0; i < numBands; ++i)
+        {
+            if ((bandsToUpdate & (1u << i)) == 0)
+                continue;
+
+            designCurrent (i);
+
+            auto& response = bands [size_t (i)];
+            evaluateCached (current [size_t (i)]);
+
+            if (! resum && (active & (1u << i)) != 0)
+            {
+                juce::FloatVectorOperations::subtract (overall.data(), response.data(), numPoints);
+                juce::FloatVectorOperations::add      (overall.data(), scratch.data(),  numPoints);
+            }
+            std::swap (response, scratch);
+        }
+
+        if (resum)
+        {
+            // adding the differences accumulates rounding errors, so it is summed up again now and then
+            juce::FloatVectorOperations::fill (overall.data(), std::log2 (std::max (gain, 1.0e-6f)), numPoints);
+            for (int i = 0; i < numBands; ++i)
+                if ((active & (1u << i)) != 0)
+                    juce::FloatVectorOperations::add (overall.data(), bands [size_t (i)].data(), numPoints);
+
+            numIncrementalUpdates = 0;
+        }
+
+        {
+            const juce::ScopedLock lock (publishLock);
+            if (publishedOverall.size() != overall.size())
+                resizeResponses (publishedBands, publishedOverall, numPoints);
+
+            for (int i = 0; i < numBands; ++i)
+                if ((bandsToUpdate & (1u << i)) != 0)
+                    std::copy (bands [size_t (i)].begin(), bands [size_t (i)].end(), publishedBands [size_t (i)].begin());
+
+            std::copy (overall.begin(), overall.end(), publishedOverall.begin());
+        }
+
+        changedBands.fetch_or (bandsToUpdate | overallChanged);
+    }
+
+    void prepareGrid()
+    {
+        cos1.resize (size_t (numPoints));
+        cos2.resize (size_t (numPoints));
+        numerator.resize (size_t (numPoints));
+        denominator.resize (size_t (numPoints));
+        scratch.resize (size_t (numPoints));
+
+        for (auto& cached : cachedResponses)
+        {
+            cached.log2Magnitudes.resize (size_t (numPoints));
+            cached.valid = false;
+        }
+
+        const auto nyquist = sampleRate > 0 ? 0.5 * sampleRate : 24000.0;
+        for (size_t i = 0; i < size_t (numPoints); ++i)
+        {
+            const auto frequency = std::min (20.0 * std::pow (2.0, 10.0 * double (i) / double (numPoints)), nyquist);
+            const auto omega = juce::MathConstants<double>::twoPi * frequency / (2.0 * nyquist);
+            cos1 [i] = std::cos (omega);
+            cos2 [i] = std::cos (2.0 * omega);
+        }
+    }
+
+    void designCurrent (int index)
+    {
+        if (sampleRate <= 0 || designBand == nullptr)
+            return;
+
+        const auto coefficients = designBand (index, sampleRate);
+        auto& band = current [size_t (index)];
+        band.b0 = coefficients [0];
+        band.b1 = coefficients [1];
+        band.b2 = coefficients [2];
+        band.a1 = coefficients [3];
+        band.a2 = coefficients [4];
+    }
+
+    /** Evaluates into scratch, or copies a cached curve of the same coefficients */
+    void evaluateCached (const Biquad& c)
+    {
+        for (const auto& cached : cachedResponses)
+        {
+            if (cached.valid && cached.coefficients == c)
+            {
+                std::copy (cached.log2Magnitudes.begin(), cached.log2Magnitudes.end(), scratch.begin());
+                numCacheHits.fetch_add (1, std::memory_order_relaxed);
+                return;
+            }
+        }
+
+        numCacheMisses.fetch_add (1, std::memory_order_relaxed);
+        evaluate (c, scratch.data());
+
+        auto& slot = cachedResponses [nextCachedResponse];
+        nextCachedResponse = (nextCachedResponse + 1) % numCachedResponses;
+        slot.coefficients = c;
+        std::copy (scratch.begin(), scratch.end(), slot.log2Magnitudes.begin());
+        slot.valid = true;
+    }
+
+    /** |H|^2 = (b0^2 + b1^2 + b2^2 + 2 (b0 b1 + b1 b2) cos w + 2 b0 b2 cos 2w)
+               / (1 + a1^2 + a2^2 + 2 (a1 + a1 a2) cos w + 2 a2 cos 2w)
+        which is two multiply-adds per point for numerator and denominator each. */
+    void evaluate (const Biquad& c, float* log2Magnitudes)
+    {
+        const auto num = size_t (numPoints);
+
+        juce::FloatVectorOperations::copyWithMultiply (numerator.data(), cos1.data(), 2.0 * (c.b0 * c.b1 + c.b1 * c.b2), int (num));
+        juce::FloatVectorOperations::addWithMultiply  (numerator.data(), cos2.data(), 2.0 * c.b0 * c.b2, int (num));
+        juce::FloatVectorOperations::add              (numerator.data(), c.b0 * c.b0 + c.b1 * c.b1 + c.b2 * c.b2, int (num));
+
+        juce::FloatVectorOperations::copyWithMultiply (denominator.data(), cos1.data(), 2.0 * (c.a1 + c.a1 * c.a2), int (num));
+        juce::FloatVectorOperations::addWithMultiply  (denominator.data(), cos2.data(), 2.0 * c.a2, int (num));
+        juce::FloatVectorOperations::add              (denominator.data(), 1.0 + c.a1 * c.a1 + c.a2 * c.a2, int (num));
+
+        for (size_t i = 0; i < num; ++i)
+            log2Magnitudes [i] = float (0.5 * std::log2 (std::max (numerator [i], 1.0e-20) / std::max (denominator [i], 1.0e-20)));
+    }
+
+    static void resizeResponses (std::vector<std::vector<float>>& responses, std::vector<float>& sum, int size)
+    {
+        for (auto& response : responses)
+            response.assign (size_t (size), 0.0f);
+
+        sum.assign (size_t (size), 0.0f);
+    }
+
+    const int numBands;
+
+    std::atomic<juce::uint32> pendingBands      { 0 };
+    std::atomic<int>          pendingNumPoints  { 300 };
+    std::atomic<double>       pendingSampleRate { 0.0 };
+    std::atomic<float>        pendingGain       { 1.0f };
+    std::atomic<juce::uint32> pendingActive     { 0 };
+    juce::WaitableEvent     waitForUpdate;
+    std::atomic<bool>       pendingChanges { false };
+
+    // only used on the thread
+    std::vector<Biquad>     current;
+    int                     numPoints  = 0;
+    double                  sampleRate = 0.0;
+    float                   gain       = 1.0f;
+    juce::uint32            active     = 0;
+    int                     numIncrementalUpdates = 0;
+    std::vector<double>     cos1, cos2, numerator, denominator;
+    std::vector<float>      scratch;
+    std::array<CachedResponse, numCachedResponses> cachedResponses;
+    size_t                  nextCachedResponse = 0;
+    std::vector<std::vector<float>> bands;
+    std::vector<float>      overall;
+
+    juce::CriticalSection   publishLock;
+    std::vector<std::vector<float>> publishedBands;
+    std::vector<float>      publishedOverall;
+    std::atomic<juce::uint32> changedBands { 0 };
+    std::atomic<juce::int64>  numCacheHits { 0 }, numCacheMisses { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ResponseCurves)
+};
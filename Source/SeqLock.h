@@ -0,0 +1,104 @@
+/*
+  ==============================================================================
+
+    This publishes a small struct from any thread without blocking the readers
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+//==============================================================================
+/**
+    A sequence lock around a trivially copyable value. Writers are serialised by a
+    spin lock and bump the sequence before and after writing, readers copy the value
+    and retry if the sequence was odd or changed meanwhile. A reader never waits for
+    a lock and never sees a half written value, which makes it safe on the audio
+    thread, as long as writes are short and rare compared to the reads.
+
+    The value is kept in atomic words on its own cache line, so the copying is free
+    of data races in the sense of the memory model and ThreadSanitizer as well. On
+    x86 and ARM64 these loads and stores are plain moves.
+*/
+template <typename Type>
+class SeqLock
+{
+public:
+    static_assert (std::is_trivially_copyable<Type>::value, "SeqLock needs a trivially copyable type");
+
+    SeqLock() : SeqLock (Type {}) {}
+
+    explicit SeqLock (const Type& initialValue) : value (initialValue)
+    {
+        write (initialValue);
+    }
+
+    /** Returns a consistent copy, from any thread */
+    Type load() const
+    {
+        std::array<juce::uint32, numWords> buffer;
+
+        for (;;)
+        {
+            const auto before = sequence.load (std::memory_order_acquire);
+            if ((before & 1u) == 0)
+            {
+                // acquiring each word keeps the second sequence load behind them
+                for (size_t i = 0; i < numWords; ++i)
+                    buffer [i] = words [i].load (std::memory_order_acquire);
+
+                if (sequence.load (std::memory_order_relaxed) == before)
+                    break;
+            }
+        }
+
+        Type result;
+        std::memcpy (static_cast<void*> (&result), buffer.data(), sizeof (Type));
+        return result;
+    }
+
+    void store (const Type& newValue)
+    {
+        const juce::SpinLock::ScopedLockType lock (writeLock);
+        value = newValue;
+        write (value);
+    }
+
+    /** Changes the value in place with a function taking a Type&, concurrent writers are serialised */
+    template <typename Function>
+    void modify (Function&& function)
+    {
+        const juce::SpinLock::ScopedLockType lock (writeLock);
+        function (value);
+        write (value);
+    }
+
+private:
+    static constexpr size_t numWords = (sizeof (Type) + sizeof (juce::uint32) - 1) / sizeof (juce::uint32);
+
+    void write (const Type& newValue)
+    {
+        std::array<juce::uint32, numWords> buffer {};
+        std::memcpy (buffer.data(), &newValue, sizeof (Type));
+
+        const auto current = sequence.load (std::memory_order_relaxed);
+        sequence.store (current + 1, std::memory_order_relaxed);
+
+        // a reader, that sees any new word, also sees the odd sequence
+        for (size_t i = 0; i < numWords; ++i)
+            words [i].store (buffer [i], std::memory_order_release);
+
+        sequence.store (current + 2, std::memory_order_release);
+    }
+
+    alignas (64) std::atomic<juce::uint32>  sequence { 0 };
+    std::array<std::atomic<juce::uint32>, numWords> words {};
+
+    // only touched by writers, holding the writeLock
+    alignas (64) juce::SpinLock writeLock;
+    Type                        value;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SeqLock)
+};
@@ -0,0 +1,395 @@
+/*
+  ==============================================================================
+
+    This switches and morphs between stored settings of the Frequalizer
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+#include "SeqLock.h"
+
+//==============================================================================
+/**
+    Keeps a few snapshots of all band settings together with their coefficients,
+    computed when the snapshot is stored. Once engaged the audio thread plays the
+    snapshots instead of the parameters: selecting a snapshot or a morph position
+    only sets atomics, the message thread does no further work.
+
+    The audio thread moves towards the selected settings in steps of
+    controlInterval samples. Frequency, quality and gain glide in the log domain,
+    with a glide time of zero the precomputed coefficients are used directly.
+    Types and bypass can't glide and switch in the middle of a morph.
+
+    While engaged, parameter changes are stored in a hidden live snapshot, that
+    release() glides back to before the parameters take over again. Automation
+    can change it on the audio thread, so it is published through a SeqLock and
+    copied into the slot by whoever gets the slot lock next.
+*/
+class Snapshots
+{
+public:
+    static constexpr size_t numBands        = 6;
+    static constexpr int    numSlots        = 4;
+    static constexpr int    controlInterval = 32;
+
+    /** b0, b1, b2, a1, a2 normalised by a0, first order filters have b2 and a2 zero */
+    using Biquad = std::array<float, 5>;
+
+    using MakeBiquad = Biquad (*) (int type, double sampleRate, float frequency, float quality, float gain);
+
+    struct Band
+    {
+        int   type      = 0;
+        float frequency = 1000.0f;
+        float quality   = 1.0f;
+        float gain      = 1.0f;
+        bool  active    = true;
+    };
+
+    struct Settings
+    {
+        std::array<Band, numBands> bands;
+        float outputGain = 1.0f;
+    };
+
+    /** What the audio thread applies to the filter after each step */
+    struct Frame
+    {
+        std::array<Biquad, numBands> coefficients {};
+        juce::uint32 changedBands = 0;
+        juce::uint32 activeBands  = 0;
+        float        outputGain   = 1.0f;
+    };
+
+    explicit Snapshots (MakeBiquad makeBiquadToUse) : makeBiquad (makeBiquadToUse) {}
+
+    //==============================================================================
+    void setSampleRate (double sampleRateToUse)
+    {
+        const juce::SpinLock::ScopedLockType lock (slotLock);
+        sampleRate = sampleRateToUse;
+        for (auto& slot : slots)
+            if (slot.stored)
+                computeCoefficients (slot);
+    }
+
+    void setGlideTime (float seconds)
+    {
+        glideTime.store (std::max (0.0f, seconds));
+    }
+
+    void store (int slot, const Settings& settings)
+    {
+        if (juce::isPositiveAndBelow (slot, numSlots))
+            storeSlot (size_t (slot), settings);
+    }
+
+    bool isStored (int slot) const
+    {
+        const juce::SpinLock::ScopedLockType lock (slotLock);
+        return juce::isPositiveAndBelow (slot, numSlots) && slots [size_t (slot)].stored;
+    }
+
+    /** Starts playing snapshots, beginning at the live settings */
+    void engage (const Settings& live)
+    {
+        if (isEngaged())
+            return;
+
+        storeSlot (liveSlot, live);
+        selectedA.store (int (liveSlot));
+        selectedB.store (int (liveSlot));
+        morph.store (0.0f);
+
+        const juce::SpinLock::ScopedLockType lock (slotLock);
+        for (size_t i = 0; i < numBands; ++i)
+            current [i] = toGliding (live.bands [i]);
+        currentOutputGain = toLog2Gain (live.outputGain);
+        frame.coefficients = slots [liveSlot].coefficients;
+        releasing = false;
+        engaged.store (true);
+    }
+
+    /** Plays slot a, slot b or a mix of both. The snapshots need to be engaged first. */
+    void select (int a, int b, float amount)
+    {
+        if (! juce::isPositiveAndBelow (a, numSlots) || ! juce::isPositiveAndBelow (b, numSlots))
+            return;
+
+        {
+            const juce::SpinLock::ScopedLockType lock (slotLock);
+            releasing = false;
+        }
+
+        selectedA.store (a);
+        selectedB.store (b);
+        morph.store (juce::jlimit (0.0f, 1.0f, amount));
+    }
+
+    /** Glides back to the live settings, then the audio thread disengages itself */
+    void release (const Settings& live)
+    {
+        if (! isEngaged())
+            return;
+
+        storeSlot (liveSlot, live);
+        selectedA.store (int (liveSlot));
+        selectedB.store (int (liveSlot));
+        morph.store (0.0f);
+
+        const juce::SpinLock::ScopedLockType lock (slotLock);
+        releasing = true;
+    }
+
+    bool isEngaged() const
+    {
+        return engaged.load();
+    }
+
+    /** Stores changed parameters while engaged. Returns false if the snapshots are not
+        engaged, so the caller needs to update the filter itself. Never waits for the
+        slot lock, if another thread holds it the change stays pending until the next
+        advance() or store. */
+    bool updateLive (const Settings& live)
+    {
+        if (! engaged.load())
+            return false;
+
+        publishLive (live);
+
+        {
+            const juce::SpinLock::ScopedTryLockType lock (slotLock);
+            if (lock.isLocked())
+                applyPendingLive();
+        }
+
+        // if advance() disengaged meanwhile, either it saw the pending change or this sees it disengaged
+        return engaged.load();
+    }
+
+    //==============================================================================
+    /** Called by the audio thread before each step of controlInterval samples.
+        Returns nullptr while disengaged or while the message thread stores a snapshot. */
+    const Frame* advance (int numSamples)
+    {
+        if (! engaged.load (std::memory_order_relaxed))
+            return nullptr;
+
+        const juce::SpinLock::ScopedTryLockType lock (slotLock);
+        if (! lock.isLocked() || sampleRate <= 0)
+            return nullptr;
+
+        applyPendingLive();
+
+        const auto& slotA  = slots [size_t (selectedA.load())];
+        const auto& slotB  = slots [size_t (selectedB.load())];
+        const auto  amount = morph.load();
+        if (! slotA.stored || ! slotB.stored)
+            return nullptr;
+
+        // at either end of a morph the stored coefficients are exact
+        const auto* endpoint = (amount <= 0.0f || &slotA == &slotB) ? &slotA : (amount >= 1.0f ? &slotB : nullptr);
+        const auto  glide = glideTime.load();
+        const auto  alpha = glide > 0.0f ? float (1.0 - std::exp (-numSamples / (glide * sampleRate))) : 1.0f;
+
+        frame.changedBands = 0;
+        frame.activeBands  = 0;
+        auto arrived = true;
+
+        for (size_t i = 0; i < numBands; ++i)
+        {
+            const auto target = interpolate (slotA.settings.bands [i], slotB.settings.bands [i], amount);
+            auto& band = current [i];
+
+            const auto typeChanged = band.type != target.type;
+            band.type   = target.type;
+            band.active = target.active;
+
+            auto moved = glideTowards (band.log2Frequency, target.log2Frequency, alpha);
+            moved = glideTowards (band.log2Quality, target.log2Quality, alpha) || moved;
+            moved = glideTowards (band.log2Gain, target.log2Gain, alpha) || moved;
+
+            if (band.active)
+                frame.activeBands |= 1u << i;
+
+            if (moved || typeChanged)
+            {
+                frame.changedBands |= 1u << i;
+                frame.coefficients [i] = makeBiquad (band.type, sampleRate, std::exp2 (band.log2Frequency),
+                                                     std::exp2 (band.log2Quality), std::exp2 (band.log2Gain));
+            }
+
+            const auto atTarget = ! moved || (band.log2Frequency == target.log2Frequency
+                                              && band.log2Quality == target.log2Quality
+                                              && band.log2Gain == target.log2Gain);
+
+            if (atTarget && endpoint != nullptr && frame.coefficients [i] != endpoint->coefficients [i])
+            {
+                frame.coefficients [i] = endpoint->coefficients [i];
+                frame.changedBands |= 1u << i;
+            }
+
+            arrived = arrived && atTarget;
+        }
+
+        const auto targetGain = (1.0f - amount) * toLog2Gain (slotA.settings.outputGain)
+                                        + amount  * toLog2Gain (slotB.settings.outputGain);
+        arrived = ! glideTowards (currentOutputGain, targetGain, alpha) && arrived;
+        frame.outputGain = (arrived && endpoint != nullptr) ? endpoint->settings.outputGain : std::exp2 (currentOutputGain);
+
+        if (releasing && arrived)
+        {
+            releasing = false;
+            engaged.store (false);
+
+            // a change published after the glide arrived, that updateLive() left to the snapshots
+            if (applyPendingLive())
+            {
+                const auto& live = slots [liveSlot];
+                frame.coefficients = live.coefficients;
+                frame.changedBands = (1u << numBands) - 1;
+                frame.activeBands  = 0;
+                for (size_t i = 0; i < numBands; ++i)
+                    if (live.settings.bands [i].active)
+                        frame.activeBands |= 1u << i;
+                frame.outputGain = live.settings.outputGain;
+            }
+        }
+
+        return &frame;
+    }
+
+private:
+    struct Slot
+    {
+        Settings settings;
+        std::array<Biquad, numBands> coefficients {};
+        bool stored = false;
+    };
+
+    struct Gliding
+    {
+        int   type          = 0;
+        bool  active        = true;
+        float log2Frequency = 0.0f;
+        float log2Quality   = 0.0f;
+        float log2Gain      = 0.0f;
+    };
+
+    static constexpr size_t liveSlot = numSlots;
+
+    static float toLog2Gain (float gain)
+    {
+        return std::log2 (std::max (gain, 1.0e-5f));
+    }
+
+    static Gliding toGliding (const Band& band)
+    {
+        return { band.type, band.active, std::log2 (band.frequency), std::log2 (band.quality), toLog2Gain (band.gain) };
+    }
+
+    /** Values of the same type are interpolated, anything else switches half way */
+    static Gliding interpolate (const Band& a, const Band& b, float amount)
+    {
+        if (amount <= 0.0f)
+            return toGliding (a);
+        if (amount >= 1.0f || a.type != b.type || a.active != b.active)
+            return toGliding (amount < 0.5f ? a : b);
+
+        const auto ga = toGliding (a);
+        const auto gb = toGliding (b);
+        return { a.type, a.active,
+                 ga.log2Frequency + amount * (gb.log2Frequency - ga.log2Frequency),
+                 ga.log2Quality   + amount * (gb.log2Quality   - ga.log2Quality),
+                 ga.log2Gain      + amount * (gb.log2Gain      - ga.log2Gain) };
+    }
+
+    /** Returns true if the value moved, it snaps to the target when close enough */
+    static bool glideTowards (float& value, float target, float alpha)
+    {
+        if (value == target)
+            return false;
+
+        value += alpha * (target - value);
+        if (std::abs (target - value) < 1.0e-4f)
+            value = target;
+
+        return true;
+    }
+
+    /** Only called from the message thread, the audio thread only tries the slot lock */
+    void storeSlot (size_t index, const Settings& settings)
+    {
+        if (index == liveSlot)
+            publishLive (settings);
+
+        const juce::SpinLock::ScopedLockType lock (slotLock);
+        if (index == liveSlot)
+        {
+            applyPendingLive();
+            return;
+        }
+
+        auto& slot = slots [index];
+        slot.settings = settings;
+        slot.stored   = true;
+        computeCoefficients (slot);
+    }
+
+    void publishLive (const Settings& live)
+    {
+        pendingLive.store (live);
+        livePending.store (true);
+    }
+
+    /** Needs the slot lock held. Returns true if there was a pending change. */
+    bool applyPendingLive()
+    {
+        if (! livePending.exchange (false))
+            return false;
+
+        auto& slot = slots [liveSlot];
+        slot.settings = pendingLive.load();
+        slot.stored   = true;
+        computeCoefficients (slot);
+        return true;
+    }
+
+    void computeCoefficients (Slot& slot) const
+    {
+        if (sampleRate <= 0)
+            return;
+
+        for (size_t i = 0; i < numBands; ++i)
+        {
+            const auto& band = slot.settings.bands [i];
+            slot.coefficients [i] = makeBiquad (band.type, sampleRate, band.frequency, band.quality, band.gain);
+        }
+    }
+
+    const MakeBiquad makeBiquad;
+
+    juce::SpinLock                     slotLock;
+    std::array<Slot, numSlots + 1>     slots;
+    SeqLock<Settings>                  pendingLive;
+    std::atomic<bool>                  livePending { false };
+    double                             sampleRate = 0.0;
+    bool                               releasing  = false;
+
+    std::atomic<bool>  engaged   { false };
+    std::atomic<int>   selectedA { 0 };
+    std::atomic<int>   selectedB { 0 };
+    std::atomic<float> morph     { 0.0f };
+    std::atomic<float> glideTime { 0.03f };
+
+    // only used on the audio thread while engaged
+    std::array<Gliding, numBands> current;
+    float                         currentOutputGain = 0.0f;
+    Frame                         frame;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Snapshots)
+};
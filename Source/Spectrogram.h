@@ -0,0 +1,130 @@
+/*
+  ==============================================================================
+
+    This is the scrolling spectrogram (waterfall) of the Frequalizer
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_gui_basics/juce_gui_basics.h>
+
+//==============================================================================
+/**
+    Keeps the history of analyser frames in a ring buffer image. Each new frame is
+    written as one line, the newest line is displayed on top. Painting composites
+    the two parts of the ring at the wrap around offset, so the cost per frame
+    doesn't depend on the length of the history.
+
+    The lines are added on the message thread, the OpenGL renderer takes an ordered
+    copy with copyIfChanged() to upload it as texture below its traces.
+*/
+class Spectrogram
+{
+public:
+    Spectrogram()
+    {
+        const juce::Colour stops[] = { juce::Colours::transparentBlack,
+                                       juce::Colours::darkblue.withAlpha (0.6f),
+                                       juce::Colours::darkcyan.withAlpha (0.8f),
+                                       juce::Colours::yellow,
+                                       juce::Colours::red };
+
+        for (size_t i = 0; i < colours.size(); ++i)
+        {
+            const auto pos   = float (i) / float (colours.size() - 1) * (juce::numElementsInArray (stops) - 1);
+            const auto index = std::min (int (pos), juce::numElementsInArray (stops) - 2);
+            colours [i] = stops [index].interpolatedWith (stops [index + 1], pos - float (index)).getPixelARGB();
+            colours [i].premultiply();
+        }
+    }
+
+    /** Resizes the image, which discards the history */
+    void setSize (int numPixels, int historyLength)
+    {
+        if (image.isValid() && image.getWidth() == numPixels && image.getHeight() == historyLength)
+            return;
+
+        const juce::SpinLock::ScopedLockType lock (imageLock);
+        image = juce::Image (juce::Image::ARGB, std::max (numPixels, 1), std::max (historyLength, 1), true, juce::SoftwareImageType());
+        writeLine = 0;
+        ++version;
+    }
+
+    int getNumPixels() const
+    {
+        return image.getWidth();
+    }
+
+    /** Adds one line with one level in decibels per pixel */
+    void addLine (const float* decibels, float minDecibels, float maxDecibels)
+    {
+        if (! image.isValid())
+            return;
+
+        const juce::SpinLock::ScopedLockType lock (imageLock);
+        writeLine = (writeLine + image.getHeight() - 1) % image.getHeight();
+        ++version;
+
+        juce::Image::BitmapData data (image, 0, writeLine, image.getWidth(), 1, juce::Image::BitmapData::writeOnly);
+        const auto scale = float (colours.size() - 1) / (maxDecibels - minDecibels);
+
+        for (int x = 0; x < image.getWidth(); ++x)
+        {
+            const auto index = juce::jlimit (0, int (colours.size() - 1), int ((decibels [x] - minDecibels) * scale));
+            *reinterpret_cast<juce::PixelARGB*> (data.getPixelPointer (x, 0)) = colours [size_t (index)];
+        }
+    }
+
+    void draw (juce::Graphics& g, const juce::Rectangle<int> bounds) const
+    {
+        if (! image.isValid())
+            return;
+
+        const juce::SpinLock::ScopedLockType lock (imageLock);
+        const auto height = image.getHeight();
+        const auto split  = bounds.getY() + juce::roundToInt (bounds.getHeight() * float (height - writeLine) / float (height));
+
+        g.drawImage (image, bounds.getX(), bounds.getY(), bounds.getWidth(), split - bounds.getY(),
+                     0, writeLine, image.getWidth(), height - writeLine);
+
+        if (writeLine > 0)
+            g.drawImage (image, bounds.getX(), split, bounds.getWidth(), bounds.getBottom() - split,
+                         0, 0, image.getWidth(), writeLine);
+    }
+
+    /** Copies the history into dest with the newest line on top, if lines were added since
+        the version in lastVersion. Safe to call from another thread than addLine(). */
+    bool copyIfChanged (juce::Image& dest, juce::uint32& lastVersion) const
+    {
+        const juce::SpinLock::ScopedLockType lock (imageLock);
+        if (! image.isValid() || version == lastVersion)
+            return false;
+
+        if (dest.getBounds() != image.getBounds())
+            dest = juce::Image (juce::Image::ARGB, image.getWidth(), image.getHeight(), false, juce::SoftwareImageType());
+
+        const juce::Image::BitmapData source (image, juce::Image::BitmapData::readOnly);
+        juce::Image::BitmapData target (dest, juce::Image::BitmapData::writeOnly);
+
+        for (int y = 0; y < image.getHeight(); ++y)
+            std::memcpy (target.getLinePointer (y), source.getLinePointer ((y + writeLine) % image.getHeight()),
+                         size_t (image.getWidth() * source.pixelStride));
+
+        lastVersion = version;
+        return true;
+    }
+
+private:
+    juce::Image image;
+    int         writeLine = 0;
+
+    // guards image and writeLine, the renderer copies them on the OpenGL thread
+    mutable juce::SpinLock imageLock;
+    juce::uint32           version = 0;
+
+    std::array<juce::PixelARGB, 256> colours;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Spectrogram)
+};
@@ -0,0 +1,293 @@
+/*
+  ==============================================================================
+
+    Records trace events of the Frequalizer threads
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <juce_events/juce_events.h>
+
+//==============================================================================
+/**
+    With FREQUALIZER_TRACING each thread records begin and end events into a ring
+    buffer of its own. The buffers are preallocated, a thread claims one with its
+    first event, so recording never allocates or locks. writeChromeTrace() dumps
+    the most recent events of all threads in the Chrome trace event format, which
+    can be opened in chrome://tracing or https://ui.perfetto.dev
+
+    Threads of the plugin claim their buffer up front with FREQUALIZER_TRACE_THREAD,
+    which names the thread and gives the buffer back when the thread function returns,
+    so the next new thread reuses it. Other threads only leave their id, the names are
+    resolved when the trace is written. Threads that find all buffers in use are not
+    recorded, the trace says how many.
+
+    Without the flag the macros compile to nothing.
+*/
+#if FREQUALIZER_TRACING
+
+namespace Tracing
+{
+    /** The fields are atomic, because writeChromeTrace() may read a slot the thread overwrites */
+    struct Event
+    {
+        std::atomic<const char*> name  { nullptr };    // needs to be a string literal
+        std::atomic<juce::int64> ticks { 0 };
+        std::atomic<char>        phase { 'B' };
+    };
+
+    struct ThreadBuffer
+    {
+        static constexpr size_t size = 8192;
+
+        std::array<Event, size>  events;
+        std::atomic<juce::int64> numWritten { 0 };
+        std::atomic<juce::Thread::ThreadID> threadID { nullptr };
+        std::atomic<const char*> threadName { nullptr };    // a string literal, or nullptr
+        std::atomic<int>         threadIndex { -1 };        // -1 until claimed the first time
+        std::atomic<bool>        inUse { false };
+    };
+
+    class Recorder
+    {
+    public:
+        static constexpr int maxThreads = 32;
+
+        static Recorder& getInstance()
+        {
+            static Recorder instance;
+            return instance;
+        }
+
+        void record (const char* name, char phase)
+        {
+            if (auto* buffer = getThreadBuffer())
+            {
+                const auto index = buffer->numWritten.load (std::memory_order_relaxed);
+                auto& event = buffer->events [size_t (index) % ThreadBuffer::size];
+                event.name.store  (name, std::memory_order_relaxed);
+                event.ticks.store (juce::Time::getHighResolutionTicks(), std::memory_order_relaxed);
+                event.phase.store (phase, std::memory_order_relaxed);
+                buffer->numWritten.store (index + 1, std::memory_order_release);
+            }
+        }
+
+        /** Claims a buffer for the calling thread under a name, before its first event */
+        void claimCurrentThread (const char* threadName)
+        {
+            auto& current = getCurrentThreadState();
+            if (current.claimed)
+            {
+                if (current.buffer != nullptr)
+                    current.buffer->threadName.store (threadName, std::memory_order_release);
+                return;
+            }
+
+            current.buffer  = claimBuffer (threadName);
+            current.claimed = true;
+        }
+
+        /** Gives the buffer of the calling thread back, it doesn't record any more events */
+        void releaseCurrentThread()
+        {
+            auto& current = getCurrentThreadState();
+            if (current.buffer != nullptr)
+                current.buffer->inUse.store (false, std::memory_order_release);
+
+            current.buffer  = nullptr;
+            current.claimed = false;
+        }
+
+        /** Writes the events of all threads. Events a thread overwrote while they were
+            copied are left out, so dump while the plugin is busy for the best picture. */
+        bool writeChromeTrace (const juce::File& file) const
+        {
+            const auto microsPerTick = 1.0e6 / double (juce::Time::getHighResolutionTicksPerSecond());
+            const auto numMissing = numMissingThreads.load();
+
+            juce::Thread::ThreadID messageThread = nullptr;
+            if (auto* messageManager = juce::MessageManager::getInstanceWithoutCreating())
+                messageThread = messageManager->getCurrentMessageThread();
+
+            juce::MemoryOutputStream json;
+            json << "{\"otherData\":{\"threadsNotRecorded\":\"" << numMissing << "\"},\n\"traceEvents\":[\n";
+            auto first = true;
+
+            if (numMissing > 0)
+            {
+                // a global instant event makes the gap visible in the timeline as well
+                json << "{\"name\":\"" << numMissing << " threads not recorded, all " << maxThreads << " trace buffers were in use\""
+                     << ",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0"
+                     << ",\"ts\":" << juce::String (double (firstMissingTicks.load()) * microsPerTick, 3) << "}";
+                first = false;
+            }
+
+            struct Copied
+            {
+                const char* name;
+                juce::int64 ticks;
+                char        phase;
+            };
+            std::vector<Copied> copied;
+
+            for (const auto& buffer : buffers)
+            {
+                const auto threadIndex = buffer.threadIndex.load (std::memory_order_acquire);
+                if (threadIndex < 0)
+                    continue;
+
+                if (! first)
+                    json << ",\n";
+                first = false;
+
+                juce::String threadName (buffer.threadName.load (std::memory_order_acquire));
+                if (threadName.isEmpty())
+                    threadName = buffer.threadID.load() == messageThread ? juce::String ("Message thread")
+                                                                         : "Host thread " + juce::String (threadIndex);
+
+                json << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << threadIndex
+                     << ",\"args\":{\"name\":\"" << threadName << "\"}}";
+
+                // only the events published before the copy, minus the ones overwritten during it
+                const auto end   = buffer.numWritten.load (std::memory_order_acquire);
+                const auto start = std::max (juce::int64 (0), end - juce::int64 (ThreadBuffer::size));
+
+                copied.resize (size_t (end - start));
+                for (auto index = start; index < end; ++index)
+                {
+                    const auto& event = buffer.events [size_t (index) % ThreadBuffer::size];
+                    copied [size_t (index - start)] = { event.name.load  (std::memory_order_relaxed),
+                                                        event.ticks.load (std::memory_order_relaxed),
+                                                        event.phase.load (std::memory_order_relaxed) };
+                }
+
+                std::atomic_thread_fence (std::memory_order_acquire);
+                const auto overwritten = buffer.numWritten.load (std::memory_order_relaxed) - juce::int64 (ThreadBuffer::size);
+
+                for (auto index = std::max (start, overwritten); index < end; ++index)
+                {
+                    const auto& event = copied [size_t (index - start)];
+                    if (event.name == nullptr)
+                        continue;
+
+                    json << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"" << juce::String::charToString (event.phase)
+                         << "\",\"pid\":1,\"tid\":" << threadIndex
+                         << ",\"ts\":" << juce::String (double (event.ticks) * microsPerTick, 3) << "}";
+                }
+            }
+
+            json << "\n]}\n";
+            return file.replaceWithData (json.getData(), json.getDataSize());
+        }
+
+    private:
+        Recorder() = default;
+
+        /** Trivially destructible, so a thread's first event doesn't register a destructor */
+        struct ThreadState
+        {
+            ThreadBuffer* buffer  = nullptr;
+            bool          claimed = false;
+        };
+
+        static ThreadState& getCurrentThreadState()
+        {
+            static thread_local ThreadState state;
+            return state;
+        }
+
+        ThreadBuffer* getThreadBuffer()
+        {
+            auto& current = getCurrentThreadState();
+            if (! current.claimed)
+            {
+                current.buffer  = claimBuffer (nullptr);
+                current.claimed = true;
+            }
+            return current.buffer;
+        }
+
+        ThreadBuffer* claimBuffer (const char* threadName)
+        {
+            auto* found = std::find_if (buffers.begin(), buffers.end(), [] (ThreadBuffer& candidate)
+            {
+                auto expected = false;
+                return candidate.inUse.compare_exchange_strong (expected, true, std::memory_order_acquire);
+            });
+
+            if (found == buffers.end())
+            {
+                auto expected = juce::int64 (0);
+                firstMissingTicks.compare_exchange_strong (expected, juce::Time::getHighResolutionTicks());
+                numMissingThreads.fetch_add (1);
+                return nullptr;
+            }
+
+            // a reused buffer starts empty under a new thread id, the events of the exited thread are dropped
+            auto& buffer = *found;
+            buffer.numWritten.store (0, std::memory_order_relaxed);
+            buffer.threadID.store (juce::Thread::getCurrentThreadId(), std::memory_order_relaxed);
+            buffer.threadName.store (threadName, std::memory_order_relaxed);
+            buffer.threadIndex.store (numClaimed.fetch_add (1), std::memory_order_release);
+            return &buffer;
+        }
+
+        std::array<ThreadBuffer, maxThreads> buffers;
+        std::atomic<int>         numClaimed        { 0 };
+        std::atomic<int>         numMissingThreads { 0 };
+        std::atomic<juce::int64> firstMissingTicks { 0 };
+
+        JUCE_DECLARE_NON_COPYABLE (Recorder)
+    };
+
+    /** Claims the buffer of a thread of the plugin under a name, and gives it back at the end of its thread function */
+    struct ThreadScope
+    {
+        explicit ThreadScope (const char* threadName)
+        {
+            Recorder::getInstance().claimCurrentThread (threadName);
+        }
+
+        ~ThreadScope()
+        {
+            Recorder::getInstance().releaseCurrentThread();
+        }
+
+        JUCE_DECLARE_NON_COPYABLE (ThreadScope)
+    };
+
+    /** Records a begin event on construction and the end event on destruction */
+    struct Scope
+    {
+        explicit Scope (const char* nameToUse) : name (nameToUse)
+        {
+            Recorder::getInstance().record (name, 'B');
+        }
+
+        ~Scope()
+        {
+            Recorder::getInstance().record (name, 'E');
+        }
+
+        const char* name;
+
+        JUCE_DECLARE_NON_COPYABLE (Scope)
+    };
+}
+
+ #define FREQUALIZER_TRACE_THREAD(name) const Tracing::ThreadScope JUCE_JOIN_MACRO (traceThread, __LINE__) (name);
+ #define FREQUALIZER_TRACE_SCOPE(name)  const Tracing::Scope JUCE_JOIN_MACRO (traceScope, __LINE__) (name);
+ #define FREQUALIZER_TRACE_BEGIN(name)  Tracing::Recorder::getInstance().record (name, 'B');
+ #define FREQUALIZER_TRACE_END(name)    Tracing::Recorder::getInstance().record (name, 'E');
+
+#else
+
+ #define FREQUALIZER_TRACE_THREAD(name)
+ #define FREQUALIZER_TRACE_SCOPE(name)
+ #define FREQUALIZER_TRACE_BEGIN(name)
+ #define FREQUALIZER_TRACE_END(name)
+
+#endif
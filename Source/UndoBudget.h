@@ -0,0 +1,100 @@
+/*
+  ==============================================================================
+
+    This limits the undo history of all Frequalizer instances in a process
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_data_structures/juce_data_structures.h>
+
+//==============================================================================
+/**
+    Each instance registers its UndoManager here, the instances share it through
+    a juce::SharedResourcePointer. The total budget is split evenly between the
+    instances, but no instance keeps more than its own limit. Sizes are in the
+    units of the UndoManager, for the ValueTree actions of the parameters that
+    is roughly the number of bytes.
+*/
+class UndoBudget
+{
+public:
+    static constexpr int defaultInstanceLimit = 256 * 1024;
+    static constexpr int defaultTotalBudget   = 32 * 1024 * 1024;
+    static constexpr int minTransactions      = 10;
+
+    UndoBudget() = default;
+
+    void add (juce::UndoManager& undoManager)
+    {
+        const juce::ScopedLock lock (instancesLock);
+        instances.push_back ({ &undoManager, defaultInstanceLimit });
+        rebalance();
+    }
+
+    void remove (juce::UndoManager& undoManager)
+    {
+        const juce::ScopedLock lock (instancesLock);
+        instances.erase (std::remove_if (instances.begin(), instances.end(),
+                                         [&] (const Instance& i) { return i.undoManager == &undoManager; }),
+                         instances.end());
+        rebalance();
+    }
+
+    void setInstanceLimit (juce::UndoManager& undoManager, int maxUnits)
+    {
+        const juce::ScopedLock lock (instancesLock);
+        for (auto& instance : instances)
+            if (instance.undoManager == &undoManager)
+                instance.limit = std::max (maxUnits, 0);
+        rebalance();
+    }
+
+    void setTotalBudget (int maxUnits)
+    {
+        const juce::ScopedLock lock (instancesLock);
+        totalBudget = std::max (maxUnits, 0);
+        rebalance();
+    }
+
+    /** The units all instances keep in their undo history */
+    juce::int64 getTotalUnitsInUse() const
+    {
+        const juce::ScopedLock lock (instancesLock);
+        juce::int64 total = 0;
+        for (const auto& instance : instances)
+            total += instance.undoManager->getNumberOfUnitsTakenUpByStoredCommands();
+        return total;
+    }
+
+    int getNumInstances() const
+    {
+        const juce::ScopedLock lock (instancesLock);
+        return int (instances.size());
+    }
+
+private:
+    struct Instance
+    {
+        juce::UndoManager* undoManager;
+        int                limit;
+    };
+
+    void rebalance()
+    {
+        if (instances.empty())
+            return;
+
+        const auto share = totalBudget / int (instances.size());
+        for (auto& instance : instances)
+            instance.undoManager->setMaxNumberOfStoredUnits (std::min (instance.limit, share), minTransactions);
+    }
+
+    juce::CriticalSection instancesLock;
+    std::vector<Instance> instances;
+    int                   totalBudget = defaultTotalBudget;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (UndoBudget)
+};
@@ -0,0 +1,275 @@
+/*
+  ==============================================================================
+
+    Replays an automation capture through the Frequalizer processor
+
+    frequalizer_replay <capture.fqcapture> [--runs <n>] [--output <file.wav>]
+                       [--reference <file.wav>]
+
+  ==============================================================================
+*/
+
+#include "ToolHelpers.h"
+
+#include <iostream>
+#include <numeric>
+
+//==============================================================================
+namespace
+{
+    struct Replay
+    {
+        juce::AudioBuffer<float> output;
+        std::vector<double>      blockNanos;
+        double                   automationNanos = 0.0;
+        int                      numChanges      = 0;
+    };
+
+    /** Processes all blocks with a fresh processor, the changes of a block are applied
+        right before it, like a host delivers automation */
+    Replay replay (const AutomationCapture::Reader& capture, const std::vector<AutomationCapture::Reader::Block>& blocks,
+                   juce::int64 totalSamples)
+    {
+        FrequalizerAudioProcessor processor;
+        FrequalizerTools::prepareProcessor (processor, capture.numChannels, capture.sampleRate, capture.maxBlockSize);
+
+        std::vector<juce::AudioProcessorParameter*> parameters;
+        for (const auto& paramID : capture.parameterIDs)
+        {
+            juce::AudioProcessorParameter* match = nullptr;
+            for (auto* parameter : processor.getParameters())
+                if (AutomationCapture::getParameterID (*parameter) == paramID)
+                    match = parameter;
+
+            parameters.push_back (match);
+        }
+
+        Replay result;
+        result.output.setSize (capture.numChannels, int (totalSamples));
+        result.blockNanos.reserve (blocks.size());
+
+        juce::AudioBuffer<float> buffer (capture.numChannels, capture.maxBlockSize);
+        juce::MidiBuffer midi;
+        int position = 0;
+
+        for (const auto& block : blocks)
+        {
+            const auto numSamples = block.audio.getNumSamples();
+            buffer.setSize (capture.numChannels, numSamples, false, false, true);
+            for (int channel = 0; channel < capture.numChannels; ++channel)
+                buffer.copyFrom (channel, 0, block.audio, channel, 0, numSamples);
+
+            const auto automationStart = juce::Time::getHighResolutionTicks();
+            for (const auto& change : block.changes)
+            {
+                if (! juce::isPositiveAndBelow (change.first, int (parameters.size())))
+                    continue;
+
+                if (auto* parameter = parameters [size_t (change.first)])
+                {
+                    parameter->setValueNotifyingHost (change.second);
+                    ++result.numChanges;
+                }
+            }
+
+            const auto processStart = juce::Time::getHighResolutionTicks();
+            processor.processBlock (buffer, midi);
+            const auto processEnd = juce::Time::getHighResolutionTicks();
+
+            result.automationNanos += 1.0e9 * juce::Time::highResolutionTicksToSeconds (processStart - automationStart);
+            result.blockNanos.push_back (1.0e9 * juce::Time::highResolutionTicksToSeconds (processEnd - processStart));
+
+            for (int channel = 0; channel < capture.numChannels; ++channel)
+                result.output.copyFrom (channel, position, buffer, channel, 0, numSamples);
+            position += numSamples;
+        }
+
+        processor.releaseResources();
+        return result;
+    }
+
+    bool isBitExact (const juce::AudioBuffer<float>& a, const juce::AudioBuffer<float>& b)
+    {
+        if (a.getNumChannels() != b.getNumChannels() || a.getNumSamples() != b.getNumSamples())
+            return false;
+
+        for (int channel = 0; channel < a.getNumChannels(); ++channel)
+            if (std::memcmp (a.getReadPointer (channel), b.getReadPointer (channel), size_t (a.getNumSamples()) * sizeof (float)) != 0)
+                return false;
+
+        return true;
+    }
+
+    /** Compares with a reference rendering, prints the first difference and returns true if identical */
+    bool compareWithReference (const juce::AudioBuffer<float>& output, const juce::File& file)
+    {
+        juce::AudioFormatManager formats;
+        formats.registerBasicFormats();
+
+        std::unique_ptr<juce::AudioFormatReader> reader (formats.createReaderFor (file));
+        if (reader == nullptr)
+        {
+            std::cerr << "Can't read " << file.getFullPathName() << std::endl;
+            return false;
+        }
+
+        if (int (reader->numChannels) != output.getNumChannels() || reader->lengthInSamples != output.getNumSamples())
+        {
+            std::cout << "reference has " << int (reader->numChannels) << " channels and " << reader->lengthInSamples
+                      << " samples, the replay " << output.getNumChannels() << " and " << output.getNumSamples() << std::endl;
+            return false;
+        }
+
+        juce::AudioBuffer<float> reference (int (reader->numChannels), int (reader->lengthInSamples));
+        reader->read (&reference, 0, reference.getNumSamples(), 0, true, true);
+
+        juce::int64 numDifferent = 0;
+        juce::int64 firstDifferent = -1;
+        float maxDifference = 0.0f;
+
+        for (int channel = 0; channel < output.getNumChannels(); ++channel)
+        {
+            for (int i = 0; i < output.getNumSamples(); ++i)
+            {
+                const auto a = output.getSample (channel, i);
+                const auto b = reference.getSample (channel, i);
+                if (std::memcmp (&a, &b, sizeof (float)) != 0)
+                {
+                    ++numDifferent;
+                    maxDifference = std::max (maxDifference, std::abs (a - b));
+                    if (firstDifferent < 0 || i < firstDifferent)
+                        firstDifferent = i;
+                }
+            }
+        }
+
+        if (numDifferent == 0)
+        {
+            std::cout << "bit exact with " << file.getFileName() << std::endl;
+            return true;
+        }
+
+        std::cout << numDifferent << " samples differ from " << file.getFileName() << ", first at sample " << firstDifferent
+                  << ", max difference " << juce::Decibels::gainToDecibels (maxDifference, -300.0f) << " dB" << std::endl;
+        return false;
+    }
+
+    bool writeWav (const juce::AudioBuffer<float>& audio, double sampleRate, const juce::File& file)
+    {
+        file.deleteFile();
+        std::unique_ptr<juce::OutputStream> stream (file.createOutputStream());
+        if (stream == nullptr)
+            return false;
+
+        juce::WavAudioFormat wav;
+        std::unique_ptr<juce::AudioFormatWriter> writer (wav.createWriterFor (stream.get(), sampleRate, juce::uint32 (audio.getNumChannels()),
+                                                                              32, {}, 0));
+        if (writer == nullptr)
+            return false;
+
+        stream.release();
+        return writer->writeFromAudioSampleBuffer (audio, 0, audio.getNumSamples());
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::File captureFile, outputFile, referenceFile;
+    auto numRuns = 3;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const juce::String arg (argv [i]);
+
+        if (arg == "--runs" && i + 1 < argc)
+            numRuns = juce::jlimit (1, 100, juce::String (argv [++i]).getIntValue());
+        else if (arg == "--output" && i + 1 < argc)
+            outputFile = juce::File::getCurrentWorkingDirectory().getChildFile (argv [++i]);
+        else if (arg == "--reference" && i + 1 < argc)
+            referenceFile = juce::File::getCurrentWorkingDirectory().getChildFile (argv [++i]);
+        else if (! arg.startsWith ("--") && captureFile == juce::File())
+            captureFile = juce::File::getCurrentWorkingDirectory().getChildFile (arg);
+        else
+            captureFile = juce::File();
+    }
+
+    if (captureFile == juce::File())
+    {
+        std::cout << "Usage: frequalizer_replay <capture.fqcapture> [options]\n"
+                     "\n"
+                     "  --runs <n>             replays, that need to produce identical output (default: 3)\n"
+                     "  --output <file.wav>    write the output as 32 bit float WAV\n"
+                     "  --reference <file.wav> compare the output bit by bit with an earlier output\n";
+        return 1;
+    }
+
+    AutomationCapture::Reader capture (captureFile);
+    if (! capture.isValid())
+    {
+        std::cerr << "Not a Frequalizer capture: " << captureFile.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    std::vector<AutomationCapture::Reader::Block> blocks;
+    juce::int64 totalSamples = 0;
+    juce::int64 numGaps = 0;
+    AutomationCapture::Reader::Block block;
+
+    while (capture.readNextBlock (block))
+    {
+        if (block.samplePosition != totalSamples + numGaps)
+            numGaps += block.samplePosition - (totalSamples + numGaps);
+
+        totalSamples += block.audio.getNumSamples();
+        blocks.push_back (block);
+    }
+
+    std::cout << blocks.size() << " blocks, " << totalSamples << " samples at " << capture.sampleRate << " Hz, "
+              << capture.numChannels << " channels" << std::endl;
+    if (numGaps > 0)
+        std::cout << "the capture dropped " << numGaps << " samples, the replay differs from the session there" << std::endl;
+
+    std::vector<Replay> replays;
+    for (int run = 0; run < numRuns; ++run)
+        replays.push_back (replay (capture, blocks, totalSamples));
+
+    auto deterministic = true;
+    for (size_t run = 1; run < replays.size(); ++run)
+        deterministic = deterministic && isBitExact (replays.front().output, replays [run].output);
+
+    std::cout << (deterministic ? "all runs bit exact" : "runs differ, the processing is not deterministic") << std::endl;
+
+    // the fastest run is the least disturbed by the system
+    const auto& best = *std::min_element (replays.begin(), replays.end(), [] (const auto& a, const auto& b)
+    {
+        return std::accumulate (a.blockNanos.begin(), a.blockNanos.end(), 0.0) < std::accumulate (b.blockNanos.begin(), b.blockNanos.end(), 0.0);
+    });
+
+    auto sorted = best.blockNanos;
+    std::sort (sorted.begin(), sorted.end());
+    const auto totalNanos = std::accumulate (sorted.begin(), sorted.end(), 0.0);
+
+    if (! sorted.empty())
+    {
+        std::cout << "processBlock: " << juce::String (totalNanos / double (std::max (juce::int64 (1), totalSamples)), 2) << " ns per sample, "
+                  << "median " << juce::String (sorted [sorted.size() / 2] / 1000.0, 2) << " us, "
+                  << "max " << juce::String (sorted.back() / 1000.0, 2) << " us per block, "
+                  << juce::String (1.0e9 * double (totalSamples) / capture.sampleRate / totalNanos, 1) << "x realtime" << std::endl;
+        std::cout << "automation:   " << best.numChanges << " changes, "
+                  << juce::String (best.numChanges > 0 ? best.automationNanos / best.numChanges / 1000.0 : 0.0, 2) << " us per change" << std::endl;
+    }
+
+    if (outputFile != juce::File() && ! writeWav (best.output, capture.sampleRate, outputFile))
+    {
+        std::cerr << "Can't write " << outputFile.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    if (referenceFile != juce::File() && ! compareWithReference (best.output, referenceFile))
+        return 1;
+
+    return deterministic ? 0 : 1;
+}
@@ -0,0 +1,255 @@
+/*
+  ==============================================================================
+
+    Renders audio files through the Frequalizer without a host
+
+    frequalizer_render [--state <preset>] --output <folder> [options] <files...>
+
+  ==============================================================================
+*/
+
+#include "ToolHelpers.h"
+
+#include <iostream>
+
+//==============================================================================
+/**
+    Processes one file from start to end. Reading, processing and writing happen
+    in chunks of one block, so the memory needed doesn't depend on the length of
+    the file. Each job owns its own processor, so jobs share nothing but the
+    format manager.
+*/
+class RenderJob : public juce::ThreadPoolJob
+{
+public:
+    struct Options
+    {
+        juce::MemoryBlock state;
+        juce::File        outputFolder;
+        juce::String      outputExtension;  // empty keeps the extension of the input
+        int               blockSize = 4096;
+        bool              memoryMapped = false;
+    };
+
+    RenderJob (const juce::File& inputToUse, const Options& optionsToUse, juce::AudioFormatManager& formatsToUse)
+      : juce::ThreadPoolJob (inputToUse.getFileName()),
+        input (inputToUse),
+        options (optionsToUse),
+        formats (formatsToUse)
+    {
+    }
+
+    JobStatus runJob() override
+    {
+        const auto start = juce::Time::getMillisecondCounterHiRes();
+
+        // createWriter() replaces the output, which would destroy the input before it is read
+        if (getOutputFile() == input || getOutputFile().getLinkedTarget() == input.getLinkedTarget())
+            return fail ("the output would overwrite the input, use another --output folder or --format");
+
+        auto reader = createReader();
+        if (reader == nullptr)
+            return fail ("can't read file");
+
+        const auto numChannels = int (reader->numChannels);
+        const auto length      = reader->lengthInSamples;
+
+        FrequalizerAudioProcessor processor;
+        processor.setStateInformation (options.state.getData(), int (options.state.getSize()));
+
+        if (! FrequalizerTools::prepareProcessor (processor, numChannels, reader->sampleRate, options.blockSize))
+            return fail ("unsupported number of channels: " + juce::String (numChannels));
+
+        auto writer = createWriter (*reader);
+        if (writer == nullptr)
+            return fail ("can't write " + getOutputFile().getFullPathName());
+
+        juce::AudioBuffer<float> buffer (numChannels, options.blockSize);
+        juce::MidiBuffer midi;
+
+        for (juce::int64 position = 0; position < length && ! shouldExit(); position += options.blockSize)
+        {
+            const auto numSamples = int (std::min (juce::int64 (options.blockSize), length - position));
+            buffer.setSize (numChannels, numSamples, false, false, true);
+
+            reader->read (&buffer, 0, numSamples, position, true, true);
+            processor.processBlock (buffer, midi);
+
+            if (! writer->writeFromAudioSampleBuffer (buffer, 0, numSamples))
+                return fail ("write error");
+        }
+
+        processor.releaseResources();
+
+        const auto seconds = (juce::Time::getMillisecondCounterHiRes() - start) / 1000.0;
+        report (input.getFileName() + ": " + juce::String (seconds, 2) + " s, "
+                + juce::String (length / reader->sampleRate / std::max (seconds, 0.001), 1) + "x realtime");
+
+        return jobHasFinished;
+    }
+
+    bool hasFailed() const
+    {
+        return failed;
+    }
+
+private:
+    std::unique_ptr<juce::AudioFormatReader> createReader()
+    {
+        if (options.memoryMapped)
+        {
+            // only uncompressed formats can be mapped, the others are streamed
+            if (auto* format = formats.findFormatForFileExtension (input.getFileExtension()))
+            {
+                std::unique_ptr<juce::MemoryMappedAudioFormatReader> mapped (format->createMemoryMappedReader (input));
+                if (mapped != nullptr && mapped->mapEntireFile())
+                    return mapped;
+            }
+        }
+
+        return std::unique_ptr<juce::AudioFormatReader> (formats.createReaderFor (input));
+    }
+
+    std::unique_ptr<juce::AudioFormatWriter> createWriter (const juce::AudioFormatReader& reader)
+    {
+        const auto output = getOutputFile();
+        auto* format = formats.findFormatForFileExtension (output.getFileExtension());
+        if (format == nullptr)
+            return {};
+
+        auto bitDepth = int (reader.bitsPerSample);
+        if (! format->getPossibleBitDepths().contains (bitDepth))
+            bitDepth = format->getPossibleBitDepths().contains (24) ? 24 : format->getPossibleBitDepths().getLast();
+
+        output.deleteFile();
+        auto stream = output.createOutputStream();
+        if (stream == nullptr)
+            return {};
+
+        std::unique_ptr<juce::AudioFormatWriter> writer (format->createWriterFor (stream.get(), reader.sampleRate, reader.numChannels,
+                                                                                  bitDepth, reader.metadataValues, 0));
+        if (writer != nullptr)
+            stream.release();   // owned by the writer now
+
+        return writer;
+    }
+
+    juce::File getOutputFile() const
+    {
+        const auto extension = options.outputExtension.isNotEmpty() ? options.outputExtension : input.getFileExtension();
+        return options.outputFolder.getChildFile (input.getFileNameWithoutExtension() + extension);
+    }
+
+    JobStatus fail (const juce::String& message)
+    {
+        failed = true;
+        report (input.getFileName() + ": " + message);
+        return jobHasFinished;
+    }
+
+    static void report (const juce::String& message)
+    {
+        static juce::CriticalSection outputLock;
+        const juce::ScopedLock lock (outputLock);
+        std::cout << message << std::endl;
+    }
+
+    const juce::File          input;
+    const Options&            options;
+    juce::AudioFormatManager& formats;
+    bool                      failed = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RenderJob)
+};
+
+//==============================================================================
+static void printUsage()
+{
+    std::cout << "Usage: frequalizer_render [--state <preset>] --output <folder> [options] <files...>\n"
+                 "\n"
+                 "  --state <file>    state saved by the plugin (getStateInformation), default settings if omitted\n"
+                 "  --output <folder> folder for the processed files\n"
+                 "  --format <ext>    extension of the output files, e.g. wav or flac (default: same as input)\n"
+                 "  --threads <n>     number of files processed in parallel (default: number of cores)\n"
+                 "  --block <n>       samples per processed block (default: 4096)\n"
+                 "  --mmap            memory map uncompressed input files\n";
+}
+
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    RenderJob::Options options;
+    juce::Array<juce::File> inputs;
+    juce::File stateFile;
+    auto numThreads = juce::SystemStats::getNumCpus();
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const juce::String arg (argv [i]);
+        const auto hasValue = i + 1 < argc;
+
+        if (arg == "--state" && hasValue)
+            stateFile = juce::File::getCurrentWorkingDirectory().getChildFile (argv [++i]);
+        else if (arg == "--output" && hasValue)
+            options.outputFolder = juce::File::getCurrentWorkingDirectory().getChildFile (argv [++i]);
+        else if (arg == "--format" && hasValue)
+            options.outputExtension = "." + juce::String (argv [++i]).trimCharactersAtStart (".");
+        else if (arg == "--threads" && hasValue)
+            numThreads = juce::jmax (1, juce::String (argv [++i]).getIntValue());
+        else if (arg == "--block" && hasValue)
+            options.blockSize = juce::jlimit (16, 65536, juce::String (argv [++i]).getIntValue());
+        else if (arg == "--mmap")
+            options.memoryMapped = true;
+        else if (arg.startsWith ("-"))
+        {
+            printUsage();
+            return arg == "--help" ? 0 : 1;
+        }
+        else
+            inputs.add (juce::File::getCurrentWorkingDirectory().getChildFile (arg));
+    }
+
+    if (inputs.isEmpty() || options.outputFolder == juce::File())
+    {
+        printUsage();
+        return 1;
+    }
+
+    // without a state the default settings of the plugin are used
+    if (stateFile != juce::File() && ! stateFile.loadFileAsData (options.state))
+    {
+        std::cerr << "Can't read state " << stateFile.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    if (! options.outputFolder.createDirectory())
+    {
+        std::cerr << "Can't create " << options.outputFolder.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    juce::AudioFormatManager formats;
+    formats.registerBasicFormats();
+
+    juce::OwnedArray<RenderJob> jobs;
+    {
+        juce::ThreadPool pool (juce::jmin (numThreads, inputs.size()));
+
+        for (const auto& input : inputs)
+            pool.addJob (jobs.add (new RenderJob (input, options, formats)), false);
+
+        while (pool.getNumJobs() > 0)
+            juce::Thread::sleep (50);
+    }
+
+    int numFailed = 0;
+    for (auto* job : jobs)
+        if (job->hasFailed())
+            ++numFailed;
+
+    if (numFailed > 0)
+        std::cerr << numFailed << " of " << jobs.size() << " files failed" << std::endl;
+
+    return numFailed > 0 ? 1 : 0;
+}
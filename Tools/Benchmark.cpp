@@ -0,0 +1,271 @@
+/*
+  ==============================================================================
+
+    Measures the throughput of the Frequalizer processBlock
+
+    frequalizer_benchmark [--output <file.json>] [--seconds <s>] [--quick]
+
+  ==============================================================================
+*/
+
+#include "ToolHelpers.h"
+
+#include <iostream>
+
+//==============================================================================
+/**
+    A set of band settings the processor is measured with. Bands with NoFilter
+    still run the filter with neutral coefficients, inactive bands are bypassed
+    in the processor chain.
+*/
+struct BandConfiguration
+{
+    juce::String name;
+    std::function<void (FrequalizerAudioProcessor&)> apply;
+};
+
+static std::vector<BandConfiguration> createBandConfigurations()
+{
+    using Processor = FrequalizerAudioProcessor;
+
+    auto setAllBands = [] (Processor& processor, Processor::FilterType type, bool active)
+    {
+        for (size_t i = 0; i < processor.getNumBands(); ++i)
+        {
+            FrequalizerTools::setParameter (processor, Processor::getTypeParamName (i), float (type));
+            FrequalizerTools::setParameter (processor, Processor::getFrequencyParamName (i), 100.0f * std::pow (2.0f, float (i)));
+            FrequalizerTools::setParameter (processor, Processor::getGainParamName (i), juce::Decibels::decibelsToGain (6.0f));
+            FrequalizerTools::setParameter (processor, Processor::getActiveParamName (i), active ? 1.0f : 0.0f);
+        }
+    };
+
+    return {
+        { "inactive", [=] (Processor& p) { setAllBands (p, Processor::Peak, false); } },
+        { "nofilter", [=] (Processor& p) { setAllBands (p, Processor::NoFilter, true); } },
+        { "peak",     [=] (Processor& p) { setAllBands (p, Processor::Peak, true); } },
+        { "mixed",    [] (Processor&) {} }  // the default bands: high pass, shelves, peaks and low pass
+    };
+}
+
+//==============================================================================
+struct Timing
+{
+    double minimum = 0.0;   // nanoseconds per sample and channel
+    double median  = 0.0;
+};
+
+/**
+    Processes blocks for a number of rounds and returns the time per sample and channel.
+    Each block is copied from a noise buffer first, processing the output again would
+    let boosting settings run into infinities. The optional callback runs before each
+    block, e.g. to automate parameters.
+*/
+static Timing measure (FrequalizerAudioProcessor& processor, int numChannels, int blockSize, double sampleRate,
+                       double secondsPerRound, std::function<void (int block)> beforeBlock = {})
+{
+    constexpr int numRounds = 7;
+
+    juce::Random random (42);
+    juce::AudioBuffer<float> source (numChannels, blockSize);
+    juce::AudioBuffer<float> buffer (numChannels, blockSize);
+    juce::MidiBuffer midi;
+    FrequalizerTools::fillWithNoise (source, random);
+
+    const auto blocksPerRound = std::max (1, juce::roundToInt (secondsPerRound * sampleRate / blockSize));
+    int block = 0;
+
+    auto processBlocks = [&] (int numBlocks)
+    {
+        for (int i = 0; i < numBlocks; ++i)
+        {
+            if (beforeBlock)
+                beforeBlock (block++);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+                buffer.copyFrom (channel, 0, source, channel, 0, blockSize);
+
+            processor.processBlock (buffer, midi);
+        }
+    };
+
+    processBlocks (std::max (1, blocksPerRound / 4));
+
+    std::vector<double> rounds;
+    for (int round = 0; round < numRounds; ++round)
+    {
+        const auto start = juce::Time::getHighResolutionTicks();
+        processBlocks (blocksPerRound);
+        const auto seconds = juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - start);
+
+        rounds.push_back (1.0e9 * seconds / (double (blocksPerRound) * blockSize * numChannels));
+    }
+
+    std::sort (rounds.begin(), rounds.end());
+    return { rounds.front(), rounds [rounds.size() / 2] };
+}
+
+static juce::var measureProcessBlock (const BandConfiguration& configuration, int numChannels, int blockSize,
+                                      double sampleRate, double secondsPerRound)
+{
+    FrequalizerAudioProcessor processor;
+    configuration.apply (processor);
+    if (! FrequalizerTools::prepareProcessor (processor, numChannels, sampleRate, blockSize))
+        return {};
+
+    const auto timing = measure (processor, numChannels, blockSize, sampleRate, secondsPerRound);
+
+    auto* result = new juce::DynamicObject();
+    result->setProperty ("configuration",     configuration.name);
+    result->setProperty ("channels",          numChannels);
+    result->setProperty ("blockSize",         blockSize);
+    result->setProperty ("nsPerSampleMin",    timing.minimum);
+    result->setProperty ("nsPerSampleMedian", timing.median);
+    result->setProperty ("realtimeFactor",    1.0e9 / (timing.median * numChannels * sampleRate));
+    return result;
+}
+
+/** Time of one parameter change, including the listener, the coefficient calculation
+    and handing the band to the response thread */
+static juce::var measureParameterChanges (const juce::String& name, std::function<juce::String (size_t)> getParamID,
+                                          float minValue, float maxValue, double sampleRate)
+{
+    constexpr int numChanges = 5000;
+
+    FrequalizerAudioProcessor processor;
+    FrequalizerTools::prepareProcessor (processor, 2, sampleRate, 512);
+
+    juce::Random random (42);
+    const auto numBands = processor.getNumBands();
+
+    const auto start = juce::Time::getHighResolutionTicks();
+    for (int i = 0; i < numChanges; ++i)
+        FrequalizerTools::setParameter (processor, getParamID (size_t (i) % numBands),
+                                        juce::jmap (random.nextFloat(), minValue, maxValue));
+    const auto seconds = juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - start);
+
+    auto* result = new juce::DynamicObject();
+    result->setProperty ("parameter",           name);
+    result->setProperty ("microsecondsPerCall", 1.0e6 * seconds / numChanges);
+    return result;
+}
+
+/** processBlock with one band parameter automated before each block, compared to the same
+    settings without automation */
+static juce::var measureAutomation (int numChannels, int blockSize, int changesPerBlock, double sampleRate, double secondsPerRound)
+{
+    using Processor = FrequalizerAudioProcessor;
+
+    Processor processor;
+    if (! FrequalizerTools::prepareProcessor (processor, numChannels, sampleRate, blockSize))
+        return {};
+
+    const auto staticTiming = measure (processor, numChannels, blockSize, sampleRate, secondsPerRound);
+
+    juce::Random random (42);
+    const auto automated = measure (processor, numChannels, blockSize, sampleRate, secondsPerRound, [&] (int block)
+    {
+        for (int i = 0; i < changesPerBlock; ++i)
+            FrequalizerTools::setParameter (processor, Processor::getFrequencyParamName (size_t (block + i) % processor.getNumBands()),
+                                            20.0f * std::pow (2.0f, 10.0f * random.nextFloat()));
+    });
+
+    auto* result = new juce::DynamicObject();
+    result->setProperty ("channels",                 numChannels);
+    result->setProperty ("blockSize",                blockSize);
+    result->setProperty ("changesPerBlock",          changesPerBlock);
+    result->setProperty ("nsPerSampleMedian",        automated.median);
+    result->setProperty ("nsPerSampleMedianStatic",  staticTiming.median);
+    return result;
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::File outputFile;
+    auto secondsPerRound = 0.05;
+    auto quick = false;
+    const auto sampleRate = 48000.0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const juce::String arg (argv [i]);
+
+        if (arg == "--output" && i + 1 < argc)
+            outputFile = juce::File::getCurrentWorkingDirectory().getChildFile (argv [++i]);
+        else if (arg == "--seconds" && i + 1 < argc)
+            secondsPerRound = juce::jmax (0.001, juce::String (argv [++i]).getDoubleValue());
+        else if (arg == "--quick")
+            quick = true;
+        else
+        {
+            std::cout << "Usage: frequalizer_benchmark [--output <file.json>] [--seconds <s>] [--quick]\n"
+                         "\n"
+                         "  --output <file>  write the results as JSON to a file instead of stdout\n"
+                         "  --seconds <s>    audio time processed per round (default: 0.05)\n"
+                         "  --quick          only a few block sizes and channel counts\n";
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    const auto blockSizes = quick ? std::vector<int> { 64, 512, 4096 }
+                                  : std::vector<int> { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192 };
+    const auto channelCounts = quick ? std::vector<int> { 1, 2, 8 }
+                                     : std::vector<int> { 1, 2, 4, 8, 16 };
+
+    juce::Array<juce::var> processBlockResults;
+    for (const auto& configuration : createBandConfigurations())
+    {
+        for (auto numChannels : channelCounts)
+        {
+            for (auto blockSize : blockSizes)
+            {
+                std::cerr << configuration.name << ", " << numChannels << " channels, " << blockSize << " samples" << std::endl;
+                auto result = measureProcessBlock (configuration, numChannels, blockSize, sampleRate, secondsPerRound);
+                if (! result.isVoid())
+                    processBlockResults.add (result);
+            }
+        }
+    }
+
+    using Processor = FrequalizerAudioProcessor;
+    juce::Array<juce::var> parameterResults;
+    parameterResults.add (measureParameterChanges ("frequency", Processor::getFrequencyParamName, 20.0f, 20000.0f, sampleRate));
+    parameterResults.add (measureParameterChanges ("quality",   Processor::getQualityParamName, 0.1f, 10.0f, sampleRate));
+    parameterResults.add (measureParameterChanges ("gain",      Processor::getGainParamName, 0.1f, 10.0f, sampleRate));
+    parameterResults.add (measureParameterChanges ("type",      Processor::getTypeParamName, 0.0f, float (Processor::LastFilterID - 1), sampleRate));
+
+    juce::Array<juce::var> automationResults;
+    for (auto blockSize : { 32, 64, 256, 1024 })
+        for (auto changesPerBlock : { 1, 6 })
+            automationResults.add (measureAutomation (2, blockSize, changesPerBlock, sampleRate, secondsPerRound));
+
+    auto* report = new juce::DynamicObject();
+    report->setProperty ("tool",             "frequalizer_benchmark");
+    report->setProperty ("date",             juce::Time::getCurrentTime().toISO8601 (true));
+    report->setProperty ("cpu",              juce::SystemStats::getCpuModel());
+    report->setProperty ("os",               juce::SystemStats::getOperatingSystemName());
+    report->setProperty ("juce",             juce::SystemStats::getJUCEVersion());
+   #if JUCE_DEBUG
+    report->setProperty ("debugBuild",       true);
+   #else
+    report->setProperty ("debugBuild",       false);
+   #endif
+    report->setProperty ("sampleRate",       sampleRate);
+    report->setProperty ("processBlock",     processBlockResults);
+    report->setProperty ("parameterChanged", parameterResults);
+    report->setProperty ("automation",       automationResults);
+
+    const auto json = juce::JSON::toString (juce::var (report));
+
+    if (outputFile == juce::File())
+        std::cout << json << std::endl;
+    else if (! outputFile.replaceWithText (json))
+    {
+        std::cerr << "Can't write " << outputFile.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
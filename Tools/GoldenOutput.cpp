@@ -0,0 +1,346 @@
+/*
+  ==============================================================================
+
+    Compares the Frequalizer filters with stored reference outputs
+
+    frequalizer_golden --record <file> | --compare <file>
+                       [--tolerance <dB>] [--magnitude-tolerance <dB>]
+
+  ==============================================================================
+*/
+
+#include "ToolHelpers.h"
+
+#include <iostream>
+#include <map>
+
+//==============================================================================
+/**
+    One band of the processor is set to each filter type over a grid of frequency,
+    quality, gain and sample rate, all other bands are bypassed. For every case the
+    output of a test signal and the magnitude response of the coefficients the
+    filter ran are kept. Channel 0 is an impulse, channel 1 noise, both short enough that the
+    whole grid runs in a second.
+*/
+namespace
+{
+    constexpr int numSamples     = 512;
+    constexpr int numChannels    = 2;
+    constexpr int numMagnitudes  = 64;
+    constexpr int fileMagic      = 0x4f475146;     // "FQGO"
+    constexpr int fileVersion    = 1;
+
+    struct Case
+    {
+        juce::AudioBuffer<float> output;
+        std::vector<double>      magnitudes;
+    };
+
+    using Cases = std::map<juce::String, Case>;
+
+    bool usesQuality (FrequalizerAudioProcessor::FilterType type)
+    {
+        using Processor = FrequalizerAudioProcessor;
+        return type != Processor::NoFilter && type != Processor::LowPass1st
+            && type != Processor::HighPass1st && type != Processor::AllPass1st;
+    }
+
+    bool usesGain (FrequalizerAudioProcessor::FilterType type)
+    {
+        using Processor = FrequalizerAudioProcessor;
+        return type == Processor::LowShelf || type == Processor::Peak || type == Processor::HighShelf;
+    }
+
+    Cases renderCases()
+    {
+        using Processor = FrequalizerAudioProcessor;
+
+        juce::AudioBuffer<float> signal (numChannels, numSamples);
+        signal.clear();
+        signal.setSample (0, 0, 1.0f);
+        juce::Random random (42);
+        for (int i = 0; i < numSamples; ++i)
+            signal.setSample (1, i, 0.25f * (2.0f * random.nextFloat() - 1.0f));
+
+        Cases cases;
+        juce::MidiBuffer midi;
+
+        for (auto sampleRate : { 44100.0, 48000.0, 96000.0 })
+        {
+            Processor processor;
+            FrequalizerTools::prepareProcessor (processor, numChannels, sampleRate, numSamples);
+
+            FrequalizerTools::setParameter (processor, Processor::paramOutput, 1.0f);
+            for (size_t i = 1; i < processor.getNumBands(); ++i)
+                FrequalizerTools::setParameter (processor, Processor::getActiveParamName (i), 0.0f);
+            FrequalizerTools::setParameter (processor, Processor::getActiveParamName (0), 1.0f);
+
+            double responseFrequencies [numMagnitudes];
+            for (int i = 0; i < numMagnitudes; ++i)
+                responseFrequencies [i] = std::min (20.0 * std::pow (2.0, 10.0 * i / (numMagnitudes - 1)), 0.49 * sampleRate);
+
+            for (int t = Processor::NoFilter; t < Processor::LastFilterID; ++t)
+            {
+                const auto type = Processor::FilterType (t);
+
+                const float frequencies[] = { 40.0f, 400.0f, 4000.0f, 16000.0f };
+                const float qualities[]   = { 0.3f, 1.1f, 6.1f };
+                const float gains[]       = { 0.25f, 1.0f, 4.0f };
+
+                // the first order filters and NoFilter ignore some of the values
+                const auto numFrequencies = type == Processor::NoFilter ? 1 : juce::numElementsInArray (frequencies);
+                const auto numQualities   = usesQuality (type) ? juce::numElementsInArray (qualities) : 1;
+                const auto numGains       = usesGain (type) ? juce::numElementsInArray (gains) : 1;
+
+                for (int f = 0; f < numFrequencies; ++f)
+                {
+                    for (int q = 0; q < numQualities; ++q)
+                    {
+                        for (int g = 0; g < numGains; ++g)
+                        {
+                            const auto frequency = frequencies [f];
+                            const auto quality   = qualities [q];
+                            const auto gain      = usesGain (type) ? gains [g] : 1.0f;
+
+                            FrequalizerTools::setParameter (processor, Processor::getTypeParamName (0), float (type));
+                            FrequalizerTools::setParameter (processor, Processor::getFrequencyParamName (0), frequency);
+                            FrequalizerTools::setParameter (processor, Processor::getQualityParamName (0), quality);
+                            FrequalizerTools::setParameter (processor, Processor::getGainParamName (0), gain);
+
+                            // the parameters snap to their intervals, the band has the values in use
+                            const auto band = processor.getBand (0);
+                            const auto name = Processor::getFilterTypeNames() [t] + " " + juce::String (sampleRate, 0) + " Hz"
+                                            + " f=" + juce::String (band.frequency, 2)
+                                            + " q=" + juce::String (band.quality, 3)
+                                            + " g=" + juce::String (band.gain, 4);
+
+                            auto& result = cases [name];
+                            result.output.makeCopyOf (signal);
+                            processor.reset();
+                            processor.processBlock (result.output, midi);
+
+                            // the coefficients the block above ran with
+                            result.magnitudes.resize (numMagnitudes);
+                            processor.getBandCoefficients (0).getMagnitudeForFrequencyArray (responseFrequencies, result.magnitudes.data(),
+                                                                                             size_t (numMagnitudes), sampleRate);
+                        }
+                    }
+                }
+            }
+
+            processor.releaseResources();
+        }
+
+        return cases;
+    }
+
+    bool writeCases (const Cases& cases, const juce::File& file)
+    {
+        file.deleteFile();
+        auto fileStream = file.createOutputStream();
+        if (fileStream == nullptr)
+            return false;
+
+        juce::GZIPCompressorOutputStream stream (*fileStream, 9);
+        stream.writeInt (fileMagic);
+        stream.writeInt (fileVersion);
+        stream.writeInt (int (cases.size()));
+
+        for (const auto& entry : cases)
+        {
+            stream.writeString (entry.first);
+            for (int channel = 0; channel < numChannels; ++channel)
+                for (int i = 0; i < numSamples; ++i)
+                    stream.writeFloat (entry.second.output.getSample (channel, i));
+
+            for (auto magnitude : entry.second.magnitudes)
+                stream.writeDouble (magnitude);
+        }
+
+        stream.flush();
+        return true;
+    }
+
+    bool readCases (Cases& cases, const juce::File& file)
+    {
+        juce::FileInputStream fileStream (file);
+        if (! fileStream.openedOk())
+            return false;
+
+        juce::GZIPDecompressorInputStream stream (fileStream);
+        if (stream.readInt() != fileMagic || stream.readInt() != fileVersion)
+            return false;
+
+        const auto numCases = stream.readInt();
+        for (int c = 0; c < numCases && ! stream.isExhausted(); ++c)
+        {
+            auto& result = cases [stream.readString()];
+            result.output.setSize (numChannels, numSamples);
+            for (int channel = 0; channel < numChannels; ++channel)
+                for (int i = 0; i < numSamples; ++i)
+                    result.output.setSample (channel, i, stream.readFloat());
+
+            result.magnitudes.resize (numMagnitudes);
+            for (auto& magnitude : result.magnitudes)
+                magnitude = stream.readDouble();
+        }
+
+        return int (cases.size()) == numCases;
+    }
+
+    /** Error of the output relative to the peak of the reference, in dB */
+    double getOutputError (const juce::AudioBuffer<float>& output, const juce::AudioBuffer<float>& reference)
+    {
+        float maxDifference = 0.0f, peak = 0.0f;
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            for (int i = 0; i < numSamples; ++i)
+            {
+                maxDifference = std::max (maxDifference, std::abs (output.getSample (channel, i) - reference.getSample (channel, i)));
+                peak = std::max (peak, std::abs (reference.getSample (channel, i)));
+            }
+        }
+
+        if (std::isnan (maxDifference))
+            return std::numeric_limits<double>::infinity();
+
+        return juce::Decibels::gainToDecibels (double (maxDifference) / std::max (double (peak), 1.0e-9), -400.0);
+    }
+
+    /** Largest deviation of the magnitude response, in dB */
+    double getMagnitudeError (const std::vector<double>& magnitudes, const std::vector<double>& reference)
+    {
+        auto maxError = 0.0;
+        for (size_t i = 0; i < magnitudes.size(); ++i)
+            maxError = std::max (maxError, std::abs (juce::Decibels::gainToDecibels (std::max (magnitudes [i], 1.0e-10))
+                                                     - juce::Decibels::gainToDecibels (std::max (reference [i], 1.0e-10))));
+        return maxError;
+    }
+
+    bool isBitExact (const Case& a, const Case& b)
+    {
+        for (int channel = 0; channel < numChannels; ++channel)
+            if (std::memcmp (a.output.getReadPointer (channel), b.output.getReadPointer (channel), numSamples * sizeof (float)) != 0)
+                return false;
+
+        return std::memcmp (a.magnitudes.data(), b.magnitudes.data(), numMagnitudes * sizeof (double)) == 0;
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::File recordFile, compareFile;
+    auto bitExact = true;
+    auto outputTolerance = -120.0;
+    auto magnitudeTolerance = 0.001;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const juce::String arg (argv [i]);
+        const auto hasValue = i + 1 < argc;
+
+        if (arg == "--record" && hasValue)
+            recordFile = juce::File::getCurrentWorkingDirectory().getChildFile (argv [++i]);
+        else if (arg == "--compare" && hasValue)
+            compareFile = juce::File::getCurrentWorkingDirectory().getChildFile (argv [++i]);
+        else if (arg == "--tolerance" && hasValue)
+        {
+            outputTolerance = juce::String (argv [++i]).getDoubleValue();
+            bitExact = false;
+        }
+        else if (arg == "--magnitude-tolerance" && hasValue)
+        {
+            magnitudeTolerance = juce::String (argv [++i]).getDoubleValue();
+            bitExact = false;
+        }
+        else
+        {
+            recordFile = compareFile = juce::File();
+            break;
+        }
+    }
+
+    if ((recordFile == juce::File()) == (compareFile == juce::File()))
+    {
+        std::cout << "Usage: frequalizer_golden --record <file> | --compare <file> [options]\n"
+                     "\n"
+                     "  --record <file>                render all cases and store them as reference\n"
+                     "  --compare <file>               render all cases and compare them with a reference\n"
+                     "  --tolerance <dB>               allowed output error relative to the peak, instead of bit exact (e.g. -120)\n"
+                     "  --magnitude-tolerance <dB>     allowed deviation of the magnitude responses, instead of bit exact (e.g. 0.001)\n";
+        return 1;
+    }
+
+    const auto start = juce::Time::getMillisecondCounterHiRes();
+    const auto cases = renderCases();
+    std::cout << cases.size() << " cases rendered in " << juce::String ((juce::Time::getMillisecondCounterHiRes() - start) / 1000.0, 2) << " s" << std::endl;
+
+    if (recordFile != juce::File())
+    {
+        if (! writeCases (cases, recordFile))
+        {
+            std::cerr << "Can't write " << recordFile.getFullPathName() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (! compareFile.existsAsFile())
+    {
+        std::cerr << "No reference at " << compareFile.getFullPathName() << ", record one from a known good build with --record" << std::endl;
+        return 1;
+    }
+
+    Cases references;
+    if (! readCases (references, compareFile))
+    {
+        std::cerr << "Not a Frequalizer reference: " << compareFile.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    int numFailed = 0;
+    auto worstOutput = -400.0, worstMagnitude = 0.0;
+
+    for (const auto& entry : cases)
+    {
+        const auto reference = references.find (entry.first);
+        if (reference == references.end())
+        {
+            std::cout << "missing in reference: " << entry.first << std::endl;
+            ++numFailed;
+            continue;
+        }
+
+        const auto outputError    = getOutputError (entry.second.output, reference->second.output);
+        const auto magnitudeError = getMagnitudeError (entry.second.magnitudes, reference->second.magnitudes);
+        worstOutput    = std::max (worstOutput, outputError);
+        worstMagnitude = std::max (worstMagnitude, magnitudeError);
+
+        const auto passed = bitExact ? isBitExact (entry.second, reference->second)
+                                     : outputError <= outputTolerance && magnitudeError <= magnitudeTolerance;
+        if (! passed)
+        {
+            std::cout << "FAILED " << entry.first << ": output error " << juce::String (outputError, 1) << " dB, "
+                      << "magnitude error " << juce::String (magnitudeError, 6) << " dB" << std::endl;
+            ++numFailed;
+        }
+    }
+
+    for (const auto& entry : references)
+    {
+        if (cases.find (entry.first) == cases.end())
+        {
+            std::cout << "not rendered any more: " << entry.first << std::endl;
+            ++numFailed;
+        }
+    }
+
+    std::cout << (bitExact ? "bit exact comparison, " : "tolerance comparison, ") << numFailed << " of " << cases.size() << " cases failed, "
+              << "worst output error " << juce::String (worstOutput, 1) << " dB, "
+              << "worst magnitude error " << juce::String (worstMagnitude, 6) << " dB" << std::endl;
+
+    return numFailed == 0 ? 0 : 1;
+}
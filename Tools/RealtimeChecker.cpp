@@ -0,0 +1,281 @@
+/*
+  ==============================================================================
+
+    Checks, that the audio thread code of the Frequalizer is real-time safe
+
+    frequalizer_rtcheck [--blocks <n>] [--block <n>]
+
+    The processor is compiled with FREQUALIZER_RT_CHECK, so processBlock opens a
+    RealtimeCheck::Scope. This file replaces operator new and delete, the malloc
+    family and pthread_mutex_lock, each reports a violation with a stack trace
+    when it is called inside a scope. Only glibc is supported.
+
+  ==============================================================================
+*/
+
+#include "ToolHelpers.h"
+#include "RealtimeCheck.h"
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <new>
+
+#if ! FREQUALIZER_RT_CHECK
+ #error "The checker needs the processor compiled with FREQUALIZER_RT_CHECK=1"
+#endif
+
+extern "C"
+{
+    void* __libc_malloc  (size_t);
+    void* __libc_calloc  (size_t, size_t);
+    void* __libc_realloc (void*, size_t);
+    void  __libc_free    (void*);
+}
+
+//==============================================================================
+namespace
+{
+    struct Violation
+    {
+        juce::String phase;
+        juce::String function;
+        juce::String stack;
+        int          count = 0;
+    };
+
+    std::mutex                          violationsLock;
+    std::map<juce::String, Violation>   violations;
+    const char*                         currentPhase = "";
+
+    void reportViolation (const char* function)
+    {
+        if (! RealtimeCheck::isChecking())
+            return;
+
+        const RealtimeCheck::Suspend suspend;
+
+        // the first frames are this function and the replaced function
+        auto stack = juce::SystemStats::getStackBacktrace();
+        stack = stack.fromFirstOccurrenceOf ("\n", false, false).fromFirstOccurrenceOf ("\n", false, false);
+
+        const std::lock_guard<std::mutex> lock (violationsLock);
+        auto& violation = violations [juce::String (currentPhase) + function + stack];
+        if (violation.count++ == 0)
+        {
+            violation.phase    = currentPhase;
+            violation.function = function;
+            violation.stack    = stack;
+        }
+    }
+
+    using MutexFunction = int (*) (pthread_mutex_t*);
+
+    MutexFunction getRealMutexLock()
+    {
+        static auto real = reinterpret_cast<MutexFunction> (dlsym (RTLD_NEXT, "pthread_mutex_lock"));
+        return real;
+    }
+}
+
+//==============================================================================
+extern "C"
+{
+    void* malloc (size_t size)
+    {
+        reportViolation ("malloc");
+        return __libc_malloc (size);
+    }
+
+    void* calloc (size_t num, size_t size)
+    {
+        reportViolation ("calloc");
+        return __libc_calloc (num, size);
+    }
+
+    void* realloc (void* ptr, size_t size)
+    {
+        reportViolation ("realloc");
+        return __libc_realloc (ptr, size);
+    }
+
+    void free (void* ptr)
+    {
+        if (ptr != nullptr)
+            reportViolation ("free");
+
+        __libc_free (ptr);
+    }
+
+    int pthread_mutex_lock (pthread_mutex_t* mutex)
+    {
+        reportViolation ("pthread_mutex_lock");
+        return getRealMutexLock() (mutex);
+    }
+}
+
+static void* allocate (size_t size, const char* function)
+{
+    reportViolation (function);
+    if (auto* ptr = __libc_malloc (size == 0 ? 1 : size))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+static void deallocate (void* ptr, const char* function)
+{
+    if (ptr != nullptr)
+        reportViolation (function);
+
+    __libc_free (ptr);
+}
+
+void* operator new   (size_t size)                         { return allocate (size, "operator new"); }
+void* operator new[] (size_t size)                         { return allocate (size, "operator new[]"); }
+void* operator new   (size_t size, const std::nothrow_t&) noexcept
+{
+    reportViolation ("operator new");
+    return __libc_malloc (size == 0 ? 1 : size);
+}
+void* operator new[] (size_t size, const std::nothrow_t&) noexcept
+{
+    reportViolation ("operator new[]");
+    return __libc_malloc (size == 0 ? 1 : size);
+}
+void operator delete   (void* ptr) noexcept                { deallocate (ptr, "operator delete"); }
+void operator delete[] (void* ptr) noexcept                { deallocate (ptr, "operator delete[]"); }
+void operator delete   (void* ptr, size_t) noexcept        { deallocate (ptr, "operator delete"); }
+void operator delete[] (void* ptr, size_t) noexcept        { deallocate (ptr, "operator delete[]"); }
+
+//==============================================================================
+/** Runs the processor the way a host does, each phase covers one kind of audio thread work */
+static void runPhases (int numBlocks, int blockSize)
+{
+    using Processor = FrequalizerAudioProcessor;
+    const auto sampleRate = 48000.0;
+
+    Processor processor;
+    FrequalizerTools::prepareProcessor (processor, 2, sampleRate, blockSize);
+
+    juce::Random random (42);
+    juce::AudioBuffer<float> buffer (2, blockSize);
+    juce::MidiBuffer midi;
+
+    auto processBlocks = [&] (int num, std::function<void (int)> beforeBlock)
+    {
+        for (int block = 0; block < num; ++block)
+        {
+            FrequalizerTools::fillWithNoise (buffer, random);
+
+            // hosts deliver automation on the audio thread, right before the block
+            const RealtimeCheck::Scope scope;
+            if (beforeBlock)
+                beforeBlock (block);
+
+            processor.processBlock (buffer, midi);
+        }
+    };
+
+    // hosts set the value and notify the processor's listener. The value and JUCE's listener
+    // lock are the host side, only the processor's reaction to the change is checked
+    auto automate = [&] (juce::RangedAudioParameter& param, float value)
+    {
+        {
+            const RealtimeCheck::Suspend hostSide;
+            param.setValue (value);
+        }
+        processor.parameterChanged (param.paramID, param.convertFrom0to1 (value));
+    };
+
+    currentPhase = "processBlock";
+    processBlocks (numBlocks, {});
+
+    const std::pair<const char*, std::function<juce::String (size_t)>> bandParameters[] =
+    {
+        { "automation: type",      Processor::getTypeParamName },
+        { "automation: frequency", Processor::getFrequencyParamName },
+        { "automation: quality",   Processor::getQualityParamName },
+        { "automation: gain",      Processor::getGainParamName },
+        { "automation: active",    Processor::getActiveParamName }
+    };
+
+    for (const auto& parameter : bandParameters)
+    {
+        std::vector<juce::RangedAudioParameter*> params;
+        for (size_t i = 0; i < processor.getNumBands(); ++i)
+            if (auto* param = processor.getPluginState().getParameter (parameter.second (i)))
+                params.push_back (param);
+
+        currentPhase = parameter.first;
+        processBlocks (numBlocks, [&] (int block)
+        {
+            automate (*params [size_t (block) % params.size()], random.nextFloat());
+        });
+    }
+
+    currentPhase = "automation: output";
+    auto* output = processor.getPluginState().getParameter (Processor::paramOutput);
+    processBlocks (numBlocks, [&] (int) { automate (*output, random.nextFloat()); });
+
+    currentPhase = "automation: solo";
+    processBlocks (numBlocks, [&] (int block) { processor.setBandSolo (block % 7 - 1); });
+
+    // the analyser is only fed while an editor is open, so it is driven directly
+    currentPhase = "Analyser::addAudioData";
+    Analyser<float> analyser (2);
+    analyser.setupAnalyser (int (sampleRate), float (sampleRate), 2);
+    for (int block = 0; block < numBlocks; ++block)
+    {
+        FrequalizerTools::fillWithNoise (buffer, random);
+
+        const RealtimeCheck::Scope scope;
+        analyser.addAudioData (buffer, 0, 2, 0);
+        analyser.addAudioData (buffer, 0, 2, 1);
+    }
+    analyser.stopThread (1000);
+
+    processor.releaseResources();
+    currentPhase = "";
+}
+
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    auto numBlocks = 200;
+    auto blockSize = 256;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const juce::String arg (argv [i]);
+
+        if (arg == "--blocks" && i + 1 < argc)
+            numBlocks = juce::jmax (1, juce::String (argv [++i]).getIntValue());
+        else if (arg == "--block" && i + 1 < argc)
+            blockSize = juce::jlimit (16, 8192, juce::String (argv [++i]).getIntValue());
+        else
+        {
+            std::cout << "Usage: frequalizer_rtcheck [--blocks <n>] [--block <n>]\n"
+                         "\n"
+                         "  --blocks <n>  blocks processed in each phase (default: 200)\n"
+                         "  --block <n>   samples per block (default: 256)\n";
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    runPhases (numBlocks, blockSize);
+
+    const std::lock_guard<std::mutex> lock (violationsLock);
+    for (const auto& entry : violations)
+    {
+        const auto& violation = entry.second;
+        std::cout << "[" << violation.phase << "] " << violation.function << " called " << violation.count << " times\n"
+                  << violation.stack << "\n";
+    }
+
+    std::cout << violations.size() << " distinct real-time violations" << std::endl;
+    return violations.empty() ? 0 : 1;
+}
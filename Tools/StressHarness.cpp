@@ -0,0 +1,350 @@
+/*
+  ==============================================================================
+
+    Simulates a large session with many Frequalizer instances in one process
+
+    frequalizer_stress [--instances <n>] [--seconds <s>] [--block <n>] [--rate <hz>]
+                       [--automation <p>] [--editors <per second>]
+
+  ==============================================================================
+*/
+
+#include "ToolHelpers.h"
+
+#include <iostream>
+
+#if JUCE_LINUX || JUCE_MAC
+ #include <sys/resource.h>
+#endif
+
+//==============================================================================
+namespace
+{
+    /** CPU time of the whole process in seconds, user and system */
+    double getProcessCpuSeconds()
+    {
+       #if JUCE_LINUX || JUCE_MAC
+        rusage usage;
+        getrusage (RUSAGE_SELF, &usage);
+        return double (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)
+                 + double (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1.0e6;
+       #else
+        return 0.0;
+       #endif
+    }
+
+    int getNumThreads()
+    {
+       #if JUCE_LINUX
+        return juce::File ("/proc/self/task").getNumberOfChildFiles (juce::File::findDirectories);
+       #else
+        return -1;
+       #endif
+    }
+
+    /** Resident memory in MB, on macOS only the peak is available */
+    double getResidentMegabytes()
+    {
+       #if JUCE_LINUX
+        const auto statm = juce::StringArray::fromTokens (juce::File ("/proc/self/statm").loadFileAsString(), false);
+        return statm [1].getLargeIntValue() * double (sysconf (_SC_PAGESIZE)) / (1024.0 * 1024.0);
+       #elif JUCE_MAC
+        rusage usage;
+        getrusage (RUSAGE_SELF, &usage);
+        return double (usage.ru_maxrss) / (1024.0 * 1024.0);
+       #else
+        return -1.0;
+       #endif
+    }
+}
+
+//==============================================================================
+/**
+    Calls processBlock of all instances from one thread in the rhythm of a host
+    audio callback, with random automation before each block. A callback, that
+    takes longer than the duration of the block, counts as deadline miss.
+*/
+class HostSimulation : public juce::Thread
+{
+public:
+    HostSimulation (juce::OwnedArray<FrequalizerAudioProcessor>& instancesToUse, double sampleRateToUse,
+                    int blockSizeToUse, float automationProbabilityToUse)
+      : juce::Thread ("Simulated host audio"),
+        instances (instancesToUse),
+        sampleRate (sampleRateToUse),
+        blockSize (blockSizeToUse),
+        automationProbability (automationProbabilityToUse)
+    {
+        juce::Random noise (42);
+        source.setSize (2, blockSize);
+        FrequalizerTools::fillWithNoise (source, noise);
+
+        for (int i = 0; i < instances.size(); ++i)
+            buffers.add (new juce::AudioBuffer<float> (2, blockSize));
+
+        for (auto* instance : instances)
+            for (auto* parameter : instance->getParameters())
+                parameters.push_back (parameter);
+    }
+
+    ~HostSimulation() override
+    {
+        stopThread (2000);
+    }
+
+    void run() override
+    {
+        const auto periodMs = 1000.0 * blockSize / sampleRate;
+        auto nextCallback = juce::Time::getMillisecondCounterHiRes();
+        juce::MidiBuffer midi;
+
+        while (! threadShouldExit())
+        {
+            const auto start = juce::Time::getMillisecondCounterHiRes();
+
+            for (int i = 0; i < instances.size(); ++i)
+            {
+                auto& buffer = *buffers.getUnchecked (i);
+                buffer.copyFrom (0, 0, source, 0, 0, blockSize);
+                buffer.copyFrom (1, 0, source, 1, 0, blockSize);
+
+                if (random.nextFloat() < automationProbability)
+                {
+                    const auto numPerInstance = parameters.size() / size_t (instances.size());
+                    auto* parameter = parameters [size_t (i) * numPerInstance + size_t (random.nextInt (int (numPerInstance)))];
+                    parameter->setValueNotifyingHost (random.nextFloat());
+                }
+
+                instances.getUnchecked (i)->processBlock (buffer, midi);
+            }
+
+            const auto duration = juce::Time::getMillisecondCounterHiRes() - start;
+            numCallbacks.fetch_add (1);
+            totalCallbackMs.store (totalCallbackMs.load() + duration);
+            maxCallbackMs.store (std::max (maxCallbackMs.load(), duration));
+            if (duration > periodMs)
+                numDeadlineMisses.fetch_add (1);
+
+            // a late callback doesn't make the next ones wait less, like a real driver
+            nextCallback = std::max (nextCallback + periodMs, juce::Time::getMillisecondCounterHiRes());
+            while (juce::Time::getMillisecondCounterHiRes() < nextCallback - 1.0 && ! threadShouldExit())
+                juce::Thread::sleep (1);
+            while (juce::Time::getMillisecondCounterHiRes() < nextCallback)
+                juce::Thread::yield();
+        }
+    }
+
+    std::atomic<juce::int64> numCallbacks      { 0 };
+    std::atomic<juce::int64> numDeadlineMisses { 0 };
+    std::atomic<double>      totalCallbackMs   { 0.0 };
+    std::atomic<double>      maxCallbackMs     { 0.0 };
+
+private:
+    juce::OwnedArray<FrequalizerAudioProcessor>& instances;
+    const double sampleRate;
+    const int    blockSize;
+    const float  automationProbability;
+
+    juce::AudioBuffer<float>                    source;
+    juce::OwnedArray<juce::AudioBuffer<float>>  buffers;
+    std::vector<juce::AudioProcessorParameter*> parameters;
+    juce::Random                                random { 7 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (HostSimulation)
+};
+
+//==============================================================================
+/**
+    Runs on the message thread: opens and closes editors of random instances,
+    prints a report every second and stops the dispatch loop at the end.
+
+    Each editor gets its own window, an editor without one has no peer and skips
+    all drawing as occluded. Without a display, e.g. on a headless CI machine, the
+    editors are only created, run it with xvfb-run there.
+*/
+class SessionController : public juce::Timer
+{
+public:
+    SessionController (juce::OwnedArray<FrequalizerAudioProcessor>& instancesToUse, HostSimulation& hostToUse,
+                       double secondsToRun, double editorsPerSecondToUse)
+      : instances (instancesToUse),
+        host (hostToUse),
+        endTime (juce::Time::getMillisecondCounterHiRes() + 1000.0 * secondsToRun),
+        editorsPerSecond (editorsPerSecondToUse)
+    {
+        editors.resize (size_t (instances.size()));
+        hasDisplay = juce::Desktop::getInstance().getDisplays().getPrimaryDisplay() != nullptr;
+        if (! hasDisplay)
+            std::cout << "no display: editors are not shown and don't draw, run with a display or xvfb-run" << std::endl;
+
+        lastReportTime = juce::Time::getMillisecondCounterHiRes();
+        lastCpuSeconds = getProcessCpuSeconds();
+        startTimerHz (50);
+    }
+
+    ~SessionController() override
+    {
+        editors.clear();
+    }
+
+    void timerCallback() override
+    {
+        const auto now = juce::Time::getMillisecondCounterHiRes();
+
+        if (random.nextDouble() < editorsPerSecond / 50.0)
+        {
+            const auto index = random.nextInt (instances.size());
+            auto& editor = editors [size_t (index)];
+            if (editor != nullptr)
+                editor.reset();
+            else
+                editor.reset (createWindow (*instances.getUnchecked (index)));
+        }
+
+        if (now - lastReportTime >= 1000.0)
+            report (now);
+
+        if (now >= endTime)
+        {
+            stopTimer();
+            editors.clear();
+            juce::MessageManager::getInstance()->stopDispatchLoop();
+        }
+    }
+
+private:
+    juce::AudioProcessorEditor* createWindow (FrequalizerAudioProcessor& instance)
+    {
+        auto* editor = instance.createEditorIfNeeded();
+        if (editor == nullptr || ! hasDisplay)
+            return editor;
+
+        const auto area = juce::Desktop::getInstance().getDisplays().getPrimaryDisplay()->userArea;
+        editor->setTopLeftPosition (area.getX() + random.nextInt (std::max (1, area.getWidth()  - editor->getWidth())),
+                                    area.getY() + random.nextInt (std::max (1, area.getHeight() - editor->getHeight())));
+        editor->addToDesktop (juce::ComponentPeer::windowHasTitleBar | juce::ComponentPeer::windowHasCloseButton);
+        editor->setVisible (true);
+        return editor;
+    }
+
+    void report (double now)
+    {
+        const auto cpuSeconds  = getProcessCpuSeconds();
+        const auto numOpen     = std::count_if (editors.begin(), editors.end(), [] (const auto& e) { return e != nullptr; });
+        const auto numShowing  = std::count_if (editors.begin(), editors.end(), [] (const auto& e) { return e != nullptr && e->isShowing(); });
+        const auto callbacks   = host.numCallbacks.load();
+
+        std::cout << "cpu " << juce::String (100.0 * (cpuSeconds - lastCpuSeconds) / ((now - lastReportTime) / 1000.0), 1) << " %"
+                  << ", threads " << getNumThreads()
+                  << ", rss " << juce::String (getResidentMegabytes(), 1) << " MB"
+                  << ", callbacks " << callbacks
+                  << ", misses " << host.numDeadlineMisses.load()
+                  << ", avg " << juce::String (callbacks > 0 ? host.totalCallbackMs.load() / double (callbacks) : 0.0, 3) << " ms"
+                  << ", max " << juce::String (host.maxCallbackMs.load(), 3) << " ms"
+                  << ", editors " << numOpen << " (" << numShowing << " showing)"
+                  << ", undo " << juce::File::descriptionOfSizeInBytes (instances.getFirst()->getTotalUndoMemoryUse())
+                  << ", coefficient cache " << juce::String (100.0 * instances.getFirst()->getCoefficientCacheStatistics().getHitRate(), 1) << " %"
+                  << std::endl;
+
+        lastReportTime = now;
+        lastCpuSeconds = cpuSeconds;
+    }
+
+    juce::OwnedArray<FrequalizerAudioProcessor>& instances;
+    HostSimulation& host;
+    const double    endTime;
+    const double    editorsPerSecond;
+    double          lastReportTime = 0.0;
+    double          lastCpuSeconds = 0.0;
+    juce::Random    random { 11 };
+    bool            hasDisplay = false;
+
+    std::vector<std::unique_ptr<juce::AudioProcessorEditor>> editors;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SessionController)
+};
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    auto numInstances     = 100;
+    auto seconds          = 10.0;
+    auto blockSize        = 256;
+    auto sampleRate       = 48000.0;
+    auto automation       = 0.05f;
+    auto editorsPerSecond = 2.0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const juce::String arg (argv [i]);
+        const auto hasValue = i + 1 < argc;
+
+        if (arg == "--instances" && hasValue)
+            numInstances = juce::jlimit (1, 500, juce::String (argv [++i]).getIntValue());
+        else if (arg == "--seconds" && hasValue)
+            seconds = juce::jmax (1.0, juce::String (argv [++i]).getDoubleValue());
+        else if (arg == "--block" && hasValue)
+            blockSize = juce::jlimit (16, 8192, juce::String (argv [++i]).getIntValue());
+        else if (arg == "--rate" && hasValue)
+            sampleRate = juce::jlimit (22050.0, 384000.0, juce::String (argv [++i]).getDoubleValue());
+        else if (arg == "--automation" && hasValue)
+            automation = juce::jlimit (0.0f, 1.0f, juce::String (argv [++i]).getFloatValue());
+        else if (arg == "--editors" && hasValue)
+            editorsPerSecond = juce::jlimit (0.0, 50.0, juce::String (argv [++i]).getDoubleValue());
+        else
+        {
+            std::cout << "Usage: frequalizer_stress [options]\n"
+                         "\n"
+                         "  --instances <n>       number of processors, up to 500 (default: 100)\n"
+                         "  --seconds <s>         duration of the run (default: 10)\n"
+                         "  --block <n>           samples per callback (default: 256)\n"
+                         "  --rate <hz>           sample rate (default: 48000)\n"
+                         "  --automation <p>      probability per instance and block of a parameter change (default: 0.05)\n"
+                         "  --editors <n>         editors opened or closed per second (default: 2)\n";
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    std::cout << "before: threads " << getNumThreads() << ", rss " << juce::String (getResidentMegabytes(), 1) << " MB" << std::endl;
+
+    juce::OwnedArray<FrequalizerAudioProcessor> instances;
+    for (int i = 0; i < numInstances; ++i)
+    {
+        auto* instance = instances.add (new FrequalizerAudioProcessor());
+        FrequalizerTools::prepareProcessor (*instance, 2, sampleRate, blockSize);
+    }
+
+    std::cout << "prepared " << numInstances << " instances: threads " << getNumThreads()
+              << ", rss " << juce::String (getResidentMegabytes(), 1) << " MB" << std::endl;
+
+    const auto cpuStart  = getProcessCpuSeconds();
+    const auto wallStart = juce::Time::getMillisecondCounterHiRes();
+
+    HostSimulation host (instances, sampleRate, blockSize, automation);
+    {
+        SessionController controller (instances, host, seconds, editorsPerSecond);
+        host.startThread (9);
+        juce::MessageManager::getInstance()->runDispatchLoop();
+        host.stopThread (2000);
+    }
+
+    const auto callbacks = host.numCallbacks.load();
+    const auto wallSeconds = (juce::Time::getMillisecondCounterHiRes() - wallStart) / 1000.0;
+
+    std::cout << "\n" << numInstances << " instances, " << blockSize << " samples at " << sampleRate << " Hz\n"
+              << "  cpu              " << juce::String (100.0 * (getProcessCpuSeconds() - cpuStart) / wallSeconds, 1) << " % of one core\n"
+              << "  threads          " << getNumThreads() << "\n"
+              << "  resident memory  " << juce::String (getResidentMegabytes(), 1) << " MB\n"
+              << "  callbacks        " << callbacks << "\n"
+              << "  deadline misses  " << host.numDeadlineMisses.load() << "\n"
+              << "  callback avg     " << juce::String (callbacks > 0 ? host.totalCallbackMs.load() / double (callbacks) : 0.0, 3) << " ms of "
+                                       << juce::String (1000.0 * blockSize / sampleRate, 3) << " ms\n"
+              << "  callback max     " << juce::String (host.maxCallbackMs.load(), 3) << " ms" << std::endl;
+
+    for (auto* instance : instances)
+        instance->releaseResources();
+
+    return 0;
+}
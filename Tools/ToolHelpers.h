@@ -0,0 +1,61 @@
+/*
+  ==============================================================================
+
+    Helpers shared by the command line tools
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "Analyser.h"
+#include "AutomationCapture.h"
+#include "CoefficientCache.h"
+#include "LoadMeter.h"
+#include "ResponseCurves.h"
+#include "SeqLock.h"
+#include "Snapshots.h"
+#include "UndoBudget.h"
+#include "FrequalizerProcessor.h"
+
+namespace FrequalizerTools
+{
+
+/** Sets a matching input and output layout and prepares the processor like a host would.
+    Returns false if the processor refused the number of channels. */
+inline bool prepareProcessor (FrequalizerAudioProcessor& processor, int numChannels, double sampleRate, int blockSize)
+{
+    auto channelSet = juce::AudioChannelSet::canonicalChannelSet (numChannels);
+    if (channelSet.isDisabled())
+        channelSet = juce::AudioChannelSet::discreteChannels (numChannels);
+
+    juce::AudioProcessor::BusesLayout layout;
+    layout.inputBuses.add (channelSet);
+    layout.outputBuses.add (channelSet);
+    if (! processor.setBusesLayout (layout))
+        return false;
+
+    processor.setRateAndBufferSizeDetails (sampleRate, blockSize);
+    processor.prepareToPlay (sampleRate, blockSize);
+    return true;
+}
+
+/** Sets a parameter in its natural range, notifying the processor like an automation would */
+inline void setParameter (FrequalizerAudioProcessor& processor, const juce::String& paramID, float value)
+{
+    if (auto* parameter = processor.getPluginState().getParameter (paramID))
+        parameter->setValueNotifyingHost (parameter->convertTo0to1 (value));
+}
+
+/** Fills a buffer with reproducible noise, so runs can be compared */
+inline void fillWithNoise (juce::AudioBuffer<float>& buffer, juce::Random& random, float level = 0.25f)
+{
+    for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+    {
+        auto* data = buffer.getWritePointer (channel);
+        for (int i = 0; i < buffer.getNumSamples(); ++i)
+            data [i] = level * (2.0f * random.nextFloat() - 1.0f);
+    }
+}
+
+} // namespace FrequalizerTools